@@ -5,6 +5,7 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 #include "configure.hpp"
 #include "memory.hpp"
 #include "stream.hpp"
@@ -12,16 +13,30 @@
 namespace mango
 {
 
+    // NOTE: A Buffer constructed with an Arena draws it's memory from the arena; the
+    //       memory is released when the arena is rewound so the Buffer must not outlive
+    //       the ArenaScope it was created in.
+
+    // NOTE: On Linux a heap Buffer which grows past 1 MB moves into it's own anonymous
+    //       memory mapping; the pages are committed on demand and further growth remaps
+    //       the pages with mremap() instead of copying the contents.
+
     class Buffer : public NonCopyable
     {
     private:
+        Arena* m_arena;
         Memory m_memory;
         size_t m_capacity;
         Alignment m_alignment;
+        bool m_mapped;
+
+        friend class MemoryView;
 
     public:
         explicit Buffer(Alignment alignment = Alignment());
         explicit Buffer(size_t bytes, Alignment alignment = Alignment());
+        explicit Buffer(Arena& arena, Alignment alignment = Alignment());
+        explicit Buffer(size_t bytes, Arena& arena, Alignment alignment = Alignment());
         explicit Buffer(size_t bytes, u8 value, Alignment alignment = Alignment());
         explicit Buffer(const u8* source, size_t bytes, Alignment alignment = Alignment());
         explicit Buffer(ConstMemory memory, Alignment alignment = Alignment());
@@ -44,6 +59,60 @@ namespace mango
     private:
         u8* allocate(size_t bytes, Alignment alignment) const;
         void free(u8* ptr) const;
+        bool remap(size_t bytes);
+    };
+
+    // ----------------------------------------------------------------------------
+    // RopeBuffer
+    // ----------------------------------------------------------------------------
+
+    /*
+        RopeBuffer is an append-only buffer which stores the data in a list of chunks.
+        Appending never moves or copies the data already in the buffer; the chunk size
+        grows geometrically so large outputs are stored in a small number of chunks.
+
+        Usage example:
+
+        RopeBuffer rope;
+
+        rope.append(header, header_size);
+        rope.append(data, data_size);
+
+        // gather the chunks
+        rope.write(stream);
+
+    */
+
+    class RopeBuffer : public NonCopyable
+    {
+    private:
+        struct Chunk
+        {
+            u8* address;
+            size_t size;
+            size_t capacity;
+        };
+
+        std::vector<Chunk> m_chunks;
+        size_t m_size;
+        size_t m_chunk_size;
+
+    public:
+        explicit RopeBuffer(size_t chunk_size = 64 * 1024);
+        ~RopeBuffer();
+
+        size_t size() const;
+        size_t count() const;
+        ConstMemory operator [] (size_t index) const;
+
+        void reset();
+        void append(const void* source, size_t bytes);
+
+        // reserve bytes of contiguous storage at the end of the buffer
+        u8* append(size_t bytes);
+
+        void copy(u8* dest) const;
+        void write(Stream& stream) const;
     };
 
     class MemoryStream : public Stream
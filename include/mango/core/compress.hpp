@@ -5,9 +5,11 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include "configure.hpp"
 #include "memory.hpp"
 #include "object.hpp"
+#include "stream.hpp"
 
 namespace mango
 {
@@ -34,6 +36,10 @@ namespace mango
     // This API is useful for transmitting compressed realtime data stream over high latency,
     // low bandwidth connection.
 
+    // The lz4 and zstd streams can be primed with a dictionary (see train_dictionary) which
+    // both end points must use; this improves the compression of the first blocks of the
+    // stream considerably. The dictionary memory must be valid while the stream is used.
+
     class StreamEncoder
     {
     public:
@@ -55,18 +61,73 @@ namespace mango
 
     namespace lz4
     {
-        SharedObject<StreamEncoder> createStreamEncoder(int level = 4);
-        SharedObject<StreamDecoder> createStreamDecoder();
+        SharedObject<StreamEncoder> createStreamEncoder(int level = 4, ConstMemory dictionary = ConstMemory());
+        SharedObject<StreamDecoder> createStreamDecoder(ConstMemory dictionary = ConstMemory());
     }
 
     namespace zstd
     {
-        SharedObject<StreamEncoder> createStreamEncoder(int level = 4);
-        SharedObject<StreamDecoder> createStreamDecoder();
+        SharedObject<StreamEncoder> createStreamEncoder(int level = 4, ConstMemory dictionary = ConstMemory());
+        SharedObject<StreamDecoder> createStreamDecoder(ConstMemory dictionary = ConstMemory());
     }
 
 #endif
 
+    // -----------------------------------------------------------------------
+    // dictionary
+    // -----------------------------------------------------------------------
+
+    /*
+        Small blocks compress poorly because the compressor has no history to find
+        matches from. A dictionary is a block of content typical to the data which both
+        the compressor and the decompressor use as the history. The dictionary is trained
+        from a set of sample blocks; the most frequent segments are stored so that the
+        most useful ones are at the end of the dictionary where they are closest to the
+        compressed data. The same dictionary works with zstd and lz4.
+
+        Dictionary gives the content an identity. The digested dictionary is cached per
+        thread between calls and the cache is keyed on the identity, so the content is
+        prepared once and not inspected again for every block. The Dictionary references
+        the memory; the memory must be valid and unchanged while the Dictionary or it's
+        copies are used. A new Dictionary must be created for new content, even when it
+        is in the same memory.
+
+        Usage example:
+
+        Buffer buffer(112 * 1024);
+        size_t size = train_dictionary(buffer, samples);
+        Dictionary dictionary(ConstMemory(buffer, size));
+
+        size_t bytes = zstd::compress(dest, source, dictionary, 6);
+        zstd::decompress(output, ConstMemory(dest, bytes), dictionary);
+
+    */
+
+    class Dictionary
+    {
+    protected:
+        ConstMemory m_memory;
+        u64 m_id;
+
+    public:
+        Dictionary();
+        explicit Dictionary(ConstMemory memory);
+
+        ConstMemory memory() const
+        {
+            return m_memory;
+        }
+
+        // unique for every Dictionary constructed from memory; zero for the default
+        u64 id() const
+        {
+            return m_id;
+        }
+    };
+
+    // returns the dictionary size, which is at most dest.size
+    size_t train_dictionary(Memory dest, const std::vector<ConstMemory>& samples);
+
     // -----------------------------------------------------------------------
     // memory block compression
     // -----------------------------------------------------------------------
@@ -94,6 +155,10 @@ namespace mango
         size_t bound(size_t size);
         size_t compress(Memory dest, ConstMemory source, int level = 6);
         size_t decompress(Memory dest, ConstMemory source);
+
+        // dictionary compression; lz4 uses the last 64 KB of the dictionary
+        size_t compress(Memory dest, ConstMemory source, const Dictionary& dictionary, int level = 6);
+        size_t decompress(Memory dest, ConstMemory source, const Dictionary& dictionary);
     }
 
     namespace lzo
@@ -108,6 +173,10 @@ namespace mango
         size_t bound(size_t size);
         size_t compress(Memory dest, ConstMemory source, int level = 6);
         size_t decompress(Memory dest, ConstMemory source);
+
+        // dictionary compression
+        size_t compress(Memory dest, ConstMemory source, const Dictionary& dictionary, int level = 6);
+        size_t decompress(Memory dest, ConstMemory source, const Dictionary& dictionary);
     }
 
 #endif
@@ -179,6 +248,9 @@ namespace mango
     // Optional API to give compressors a name; the compression functions
     // can be used as-is but this allows to enumerate them or ask them by name.
 
+    // The dictionary functions are nullptr for methods which do not support
+    // dictionary compression.
+
     struct Compressor
     {
         enum Method
@@ -201,10 +273,271 @@ namespace mango
         size_t (*bound)(size_t size);
         size_t (*compress)(Memory dest, ConstMemory source, int level);
         size_t (*decompress)(Memory dest, ConstMemory source);
+
+        size_t (*compress_dict)(Memory dest, ConstMemory source, const Dictionary& dictionary, int level);
+        size_t (*decompress_dict)(Memory dest, ConstMemory source, const Dictionary& dictionary);
     };
 
     std::vector<Compressor> getCompressors();
     Compressor getCompressor(Compressor::Method method);
     Compressor getCompressor(const std::string& name);
 
+    // -----------------------------------------------------------------------
+    // compression contexts
+    // -----------------------------------------------------------------------
+
+    /*
+        The memory block compression functions allocate and initialize the compressor
+        state on every call. The contexts keep the state (hash tables, probability
+        models, scratch buffers) between calls so compressing or decompressing a large
+        number of small blocks does not pay for the setup every time. The data format is
+        the same as with the functions of the compression method.
+
+        A context is used by one thread at a time. The thread contexts are created on
+        first use and are owned by the calling thread; they are valid until the thread
+        exits.
+
+        Usage example:
+
+        DecompressContext& context = getThreadDecompressContext(Compressor::DEFLATE);
+
+        for (auto& entry : entries)
+        {
+            context.decompress(entry.dest, entry.source);
+        }
+
+    */
+
+    class CompressContext : protected NonCopyable
+    {
+    public:
+        CompressContext() {}
+        virtual ~CompressContext() {}
+        virtual size_t compress(Memory dest, ConstMemory source, int level = 6) = 0;
+    };
+
+    class DecompressContext : protected NonCopyable
+    {
+    public:
+        DecompressContext() {}
+        virtual ~DecompressContext() {}
+        virtual size_t decompress(Memory dest, ConstMemory source) = 0;
+    };
+
+    std::unique_ptr<CompressContext> createCompressContext(Compressor::Method method);
+    std::unique_ptr<DecompressContext> createDecompressContext(Compressor::Method method);
+
+    CompressContext& getThreadCompressContext(Compressor::Method method);
+    DecompressContext& getThreadDecompressContext(Compressor::Method method);
+
+    // -----------------------------------------------------------------------
+    // CompressStream / DecompressStream
+    // -----------------------------------------------------------------------
+
+    /*
+        CompressStream compresses everything written into it to the output Stream and
+        DecompressStream decompresses the input Stream as it is read. Only a window of
+        the data is kept in memory at any time so the streams can process files which
+        are larger than the memory.
+
+        ZSTD and BZIP2 use the native streaming formats and interoperate with the
+        standard tools in both directions.
+
+        GZIP is written as a sequence of gzip members (one per window) which is a valid
+        gzip file; the compressed size of each member is stored in an extra field so that
+        the members can be decompressed one at a time. Any standard gzip file can be
+        read; members without the size field are decompressed incrementally.
+
+        WARNING! The other methods (DEFLATE, ZLIB, LZ4, LZMA, ..) are not incremental in
+        the underlying libraries so every window is compressed into an independent chunk
+        which is prefixed with the compressed and decompressed size (u32le, u32le); a chunk
+        where the sizes are equal is stored. This framing is specific to mango: DEFLATE
+        and ZLIB streams written by CompressStream are NOT raw deflate or zlib streams.
+        Use GZIP to exchange deflate compressed data with other tools.
+
+        DecompressStream reads standard raw deflate and zlib streams incrementally with
+        the STANDARD format. With the DEFAULT format ZLIB detects a standard zlib stream
+        from the header and DEFLATE reads the chunk framing.
+
+        finish() writes the end of the compressed stream; it is called from the destructor
+        if it has not been called before but errors can only be reported by calling it
+        explicitly. acquire() returns the remaining decompressed data in the window
+        without copying and an empty memory at the end of the stream.
+
+        Usage example:
+
+        filesystem::NativeFileStream file("log.txt.gz", Stream::WRITE);
+        CompressStream stream(file, Compressor::GZIP);
+
+        for (auto& line : lines)
+        {
+            stream.write(line.data(), line.length());
+        }
+
+        stream.finish();
+
+    */
+
+    class CompressStream : public Stream
+    {
+    protected:
+        struct CompressStreamHandle* m_handle;
+
+    public:
+        CompressStream(Stream& output, Compressor::Method method, int level = 6, size_t window = 1024 * 1024);
+        ~CompressStream();
+
+        u64 size() const;
+        u64 offset() const;
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+
+        void finish();
+    };
+
+    class DecompressStream : public Stream
+    {
+    protected:
+        struct DecompressStreamHandle* m_handle;
+
+    public:
+        enum Format
+        {
+            DEFAULT,    // the format written by CompressStream
+            STANDARD    // DEFLATE: raw deflate (RFC 1951), ZLIB: zlib (RFC 1950)
+        };
+
+        DecompressStream(Stream& input, Compressor::Method method, size_t window = 1024 * 1024, Format format = DEFAULT);
+        ~DecompressStream();
+
+        // bytes decompressed so far; the total size is not known before the end
+        u64 size() const;
+        u64 offset() const;
+
+        // seeking forward decompresses and skips the data
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+
+        ConstMemory acquire();
+    };
+
+    // -----------------------------------------------------------------------
+    // parallel compression
+    // -----------------------------------------------------------------------
+
+    /*
+        The parallel compression splits the source into independent blocks which are
+        compressed concurrently in the ThreadPool with any of the Compressors. The
+        output is a self-describing frame: a header with the method, the decompressed
+        size and the size of every compressed block, followed by the blocks. The blocks
+        are decompressed concurrently as well. Blocks which do not compress are stored.
+
+        Larger blocks compress better, smaller blocks give more parallelism; the block
+        size is clamped to range [64 KB, 1 GB].
+
+        Usage example:
+
+        Compressor compressor = getCompressor(Compressor::ZSTD);
+
+        Buffer buffer(parallel_bound(compressor, source.size));
+        size_t bytes = parallel_compress(compressor, buffer, source, 10);
+
+        Buffer output(parallel_decompress_size(ConstMemory(buffer, bytes)));
+        parallel_decompress(output, ConstMemory(buffer, bytes));
+
+    */
+
+    size_t parallel_bound(const Compressor& compressor, size_t size, size_t block_size = 4 * 1024 * 1024);
+    size_t parallel_compress(const Compressor& compressor, Memory dest, ConstMemory source, int level = 6, size_t block_size = 4 * 1024 * 1024);
+
+    // decompressed size of a parallel compressed frame
+    u64 parallel_decompress_size(ConstMemory source);
+    size_t parallel_decompress(Memory dest, ConstMemory source);
+
+    // -----------------------------------------------------------------------
+    // AutoCompressor
+    // -----------------------------------------------------------------------
+
+    /*
+        AutoCompressor selects the compression method and level for each block. The
+        block is sampled to estimate the order-0 entropy and the match density (how
+        often a short hash probe finds a repeated sequence); the compressed size of
+        every candidate method is predicted from these and the best candidate for the
+        goal is used. The chosen method is returned so that the caller can store it
+        with the block and decompress it with getCompressor(method).
+
+        RATIO: smallest predicted size from the candidates which compress at least
+               at the budget speed (MB/s, rough single core figures).
+        SPEED: fastest candidate which is predicted to save space.
+
+        Blocks which are not predicted to compress, or which grow when compressed,
+        are stored with Compressor::NONE.
+
+        Usage example:
+
+        AutoCompressor compressor(AutoCompressor::RATIO, 20.0f);
+
+        Buffer buffer(compressor.bound(block.size));
+        AutoCompressor::Result result = compressor.compress(buffer, block);
+
+        // store result.method and result.size with the block
+
+    */
+
+    class AutoCompressor
+    {
+    public:
+        enum Goal
+        {
+            SPEED,
+            RATIO,
+        };
+
+        struct Estimate
+        {
+            float entropy; // bits per byte
+            float matches; // fraction of probed positions with a match
+            float text;    // fraction of printable characters
+        };
+
+        struct Selection
+        {
+            Compressor::Method method;
+            int level;
+        };
+
+        struct Result
+        {
+            Compressor::Method method;
+            int level;
+            size_t size;
+        };
+
+    protected:
+        Goal m_goal;
+        float m_budget;
+
+    public:
+        AutoCompressor(Goal goal = RATIO, float budget = 50.0f);
+        ~AutoCompressor();
+
+        static Estimate estimate(ConstMemory source);
+
+        Selection select(ConstMemory source) const;
+        size_t bound(size_t size) const;
+        Result compress(Memory dest, ConstMemory source) const;
+    };
+
 } // namespace mango
@@ -24,4 +24,5 @@
 #include "memory.hpp"
 #include "string.hpp"
 #include "thread.hpp"
+#include "coroutine.hpp"
 #include "dynamic_library.hpp"
@@ -0,0 +1,539 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#pragma once
+
+#include "configure.hpp"
+#include "thread.hpp"
+
+// The coroutine front-end is header-only and compiled only when the client code is
+// compiled with C++20 coroutine support; the library itself does not depend on it.
+// The awaitable wrappers in the filesystem and image headers are declared when
+// this header is included before them (mango.hpp does this).
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+    #if __has_include(<coroutine>)
+        #define MANGO_ENABLE_COROUTINES
+    #endif
+#endif
+
+#ifdef MANGO_ENABLE_COROUTINES
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+
+namespace mango
+{
+
+    /*
+        AsyncTask<T> is a lazily started coroutine; it starts running when it is awaited
+        and resumes the awaiting coroutine when it completes. co_await schedule(pool)
+        moves the execution of the coroutine into a ThreadPool worker.
+
+        Usage example:
+
+        AsyncTask<int> compute()
+        {
+            co_await schedule(); // continue in the ThreadPool
+            co_return 7;
+        }
+
+        AsyncTask<int> sum()
+        {
+            std::vector<AsyncTask<int>> tasks;
+            tasks.push_back(compute());
+            tasks.push_back(compute());
+
+            // tasks are executed concurrently in the ThreadPool
+            std::vector<int> values = co_await when_all(std::move(tasks));
+            co_return values[0] + values[1];
+        }
+
+        // block the current thread until the result is available
+        int x = sum().get();
+
+    */
+
+    template <typename T = void>
+    class AsyncTask;
+
+namespace detail
+{
+
+    struct AsyncFinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+        {
+            // symmetric transfer to the awaiting coroutine
+            std::coroutine_handle<> continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    struct AsyncPromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        AsyncFinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            exception = std::current_exception();
+        }
+
+        void rethrow() const
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+
+    template <typename T>
+    struct AsyncPromise : AsyncPromiseBase
+    {
+        std::optional<T> value;
+
+        AsyncTask<T> get_return_object();
+
+        template <typename U>
+        void return_value(U&& result)
+        {
+            value.emplace(std::forward<U>(result));
+        }
+
+        T result()
+        {
+            rethrow();
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct AsyncPromise<void> : AsyncPromiseBase
+    {
+        AsyncTask<void> get_return_object();
+
+        void return_void()
+        {
+        }
+
+        void result()
+        {
+            rethrow();
+        }
+    };
+
+    // eagerly started coroutine which destroys itself when it completes
+    struct DetachedTask
+    {
+        struct promise_type
+        {
+            DetachedTask get_return_object() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept
+            {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept
+            {
+                return {};
+            }
+
+            void return_void()
+            {
+            }
+
+            void unhandled_exception()
+            {
+                std::terminate();
+            }
+        };
+    };
+
+    // resumes the awaiting coroutine when count() has been called for every task;
+    // the extra count is held by the awaiting coroutine until it has suspended
+    struct AsyncLatch
+    {
+        std::atomic<size_t> remaining;
+        std::coroutine_handle<> continuation;
+
+        AsyncLatch(size_t count)
+            : remaining(count + 1)
+        {
+        }
+
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            continuation = handle;
+            return remaining.fetch_sub(1, std::memory_order_acq_rel) > 1;
+        }
+
+        void await_resume() noexcept
+        {
+        }
+
+        void count()
+        {
+            if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                continuation.resume();
+            }
+        }
+    };
+
+} // namespace detail
+
+    // ----------------------------------------------------------------------------------
+    // AsyncTask
+    // ----------------------------------------------------------------------------------
+
+    template <typename T>
+    class AsyncTask : private NonCopyable
+    {
+    public:
+        using promise_type = detail::AsyncPromise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+    protected:
+        Handle m_handle;
+
+    public:
+        explicit AsyncTask(Handle handle)
+            : m_handle(handle)
+        {
+        }
+
+        AsyncTask(AsyncTask&& task) noexcept
+            : m_handle(task.m_handle)
+        {
+            task.m_handle = nullptr;
+        }
+
+        AsyncTask& operator = (AsyncTask&& task) noexcept
+        {
+            if (this != &task)
+            {
+                if (m_handle)
+                {
+                    m_handle.destroy();
+                }
+
+                m_handle = task.m_handle;
+                task.m_handle = nullptr;
+            }
+            return *this;
+        }
+
+        ~AsyncTask()
+        {
+            if (m_handle)
+            {
+                m_handle.destroy();
+            }
+        }
+
+        bool await_ready() const noexcept
+        {
+            return !m_handle || m_handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            m_handle.promise().continuation = continuation;
+            return m_handle;
+        }
+
+        T await_resume()
+        {
+            return m_handle.promise().result();
+        }
+
+        // start the task and block the current thread until the result is available
+        T get();
+    };
+
+namespace detail
+{
+
+    template <typename T>
+    AsyncTask<T> AsyncPromise<T>::get_return_object()
+    {
+        return AsyncTask<T>(std::coroutine_handle<AsyncPromise<T>>::from_promise(*this));
+    }
+
+    inline AsyncTask<void> AsyncPromise<void>::get_return_object()
+    {
+        return AsyncTask<void>(std::coroutine_handle<AsyncPromise<void>>::from_promise(*this));
+    }
+
+    // completion signal shared by a blocked thread and a detached coroutine; the
+    // signal is owned by both so it stays alive until both are done with it
+    struct AsyncSignal
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool done = false;
+
+        void notify()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+            condition.notify_all();
+        }
+
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this] { return done; });
+        }
+    };
+
+    // resumes the awaiting coroutine when the task completes; the result is left in
+    // the task and collected by the caller
+    template <typename T>
+    struct AsyncCompletion
+    {
+        std::coroutine_handle<AsyncPromise<T>> handle;
+
+        bool await_ready() noexcept
+        {
+            return handle.done();
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            handle.promise().continuation = continuation;
+            return handle;
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    template <typename T>
+    DetachedTask async_wait(std::coroutine_handle<AsyncPromise<T>> handle, std::shared_ptr<AsyncSignal> signal)
+    {
+        co_await AsyncCompletion<T> { handle };
+        signal->notify();
+    }
+
+    template <typename T>
+    DetachedTask async_start(ThreadPool& pool, AsyncTask<T>& task, std::optional<T>& result, std::exception_ptr& exception, AsyncLatch& latch);
+
+    template <typename T>
+    DetachedTask async_start(ThreadPool& pool, AsyncTask<T>& task, std::exception_ptr& exception, AsyncLatch& latch);
+
+} // namespace detail
+
+    template <typename T>
+    T AsyncTask<T>::get()
+    {
+        assert(m_handle);
+
+        auto signal = std::make_shared<detail::AsyncSignal>();
+
+        detail::async_wait(m_handle, signal);
+        signal->wait();
+
+        return m_handle.promise().result();
+    }
+
+    // ----------------------------------------------------------------------------------
+    // schedule()
+    // ----------------------------------------------------------------------------------
+
+    class ScheduleAwaiter
+    {
+    protected:
+        ThreadPool& m_pool;
+
+    public:
+        ScheduleAwaiter(ThreadPool& pool)
+            : m_pool(pool)
+        {
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            m_pool.enqueue([handle]
+            {
+                handle.resume();
+            });
+        }
+
+        void await_resume() const noexcept
+        {
+        }
+    };
+
+    // continue the execution of the awaiting coroutine in a ThreadPool worker
+    inline ScheduleAwaiter schedule(ThreadPool& pool = ThreadPool::getInstance())
+    {
+        return ScheduleAwaiter(pool);
+    }
+
+    // execute func() in the ThreadPool
+    template <typename F>
+    auto async(F func, ThreadPool& pool = ThreadPool::getInstance()) -> AsyncTask<decltype(func())>
+    {
+        co_await schedule(pool);
+
+        if constexpr (std::is_void<decltype(func())>::value)
+        {
+            func();
+        }
+        else
+        {
+            co_return func();
+        }
+    }
+
+    // ----------------------------------------------------------------------------------
+    // when_all()
+    // ----------------------------------------------------------------------------------
+
+namespace detail
+{
+
+    template <typename T>
+    DetachedTask async_start(ThreadPool& pool, AsyncTask<T>& task, std::optional<T>& result, std::exception_ptr& exception, AsyncLatch& latch)
+    {
+        co_await schedule(pool);
+
+        try
+        {
+            result.emplace(co_await task);
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        latch.count();
+    }
+
+    template <typename T>
+    DetachedTask async_start(ThreadPool& pool, AsyncTask<T>& task, std::exception_ptr& exception, AsyncLatch& latch)
+    {
+        co_await schedule(pool);
+
+        try
+        {
+            co_await task;
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+
+        latch.count();
+    }
+
+} // namespace detail
+
+    // start all tasks concurrently in the ThreadPool and resume when all of them have
+    // completed; the first exception thrown by the tasks is re-thrown to the awaiter
+
+    template <typename T>
+    AsyncTask<std::vector<T>> when_all(std::vector<AsyncTask<T>> tasks, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        const size_t count = tasks.size();
+
+        std::vector<std::optional<T>> results(count);
+        std::vector<std::exception_ptr> exceptions(count);
+        detail::AsyncLatch latch(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            detail::async_start(pool, tasks[i], results[i], exceptions[i], latch);
+        }
+
+        co_await latch;
+
+        for (auto& exception : exceptions)
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+
+        std::vector<T> values;
+        values.reserve(count);
+
+        for (auto& result : results)
+        {
+            values.push_back(std::move(*result));
+        }
+
+        co_return values;
+    }
+
+    inline AsyncTask<void> when_all(std::vector<AsyncTask<void>> tasks, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        const size_t count = tasks.size();
+
+        std::vector<std::exception_ptr> exceptions(count);
+        detail::AsyncLatch latch(count);
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            detail::async_start(pool, tasks[i], exceptions[i], latch);
+        }
+
+        co_await latch;
+
+        for (auto& exception : exceptions)
+        {
+            if (exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    }
+
+} // namespace mango
+
+#endif // MANGO_ENABLE_COROUTINES
@@ -4,6 +4,7 @@
 */
 #pragma once
 
+#include <vector>
 #include "configure.hpp"
 
 namespace mango
@@ -63,4 +64,33 @@ namespace mango
 
 	u64 getCPUFlags();
 
+	// ----------------------------------------------------------------------------
+	// getCPUTopology()
+	// ----------------------------------------------------------------------------
+
+    // The cache domains are identified by the lowest logical processor sharing the cache.
+    // The topology is read from sysfs on Linux only. Other platforms report a flat
+    // topology: every processor is it's own core and L2 domain in a single package,
+    // L3 domain and NUMA node.
+
+    struct CPUTopology
+    {
+        struct Processor
+        {
+            int id;       // logical processor (used for thread affinity)
+            int core;     // physical core; SMT siblings share the core
+            int package;  // physical package (socket)
+            int node;     // NUMA node
+            int l2;       // L2 cache domain
+            int l3;       // L3 cache domain
+        };
+
+        std::vector<Processor> processors;
+        int cores = 0;
+        int packages = 0;
+        int nodes = 0;
+    };
+
+    const CPUTopology& getCPUTopology();
+
 } // namespace mango
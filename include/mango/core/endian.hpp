@@ -85,6 +85,16 @@ namespace mango
         ustore64(p, byteswap(value));
     }
 
+    // --------------------------------------------------------------
+    // bulk byteswap
+    // --------------------------------------------------------------
+
+    // swap count values from source to dest; source and dest can be the same
+    // memory (in-place swap) but must not partially overlap
+    void byteswap16_array(u16* dest, const void* source, size_t count);
+    void byteswap32_array(u32* dest, const void* source, size_t count);
+    void byteswap64_array(u64* dest, const void* source, size_t count);
+
     // --------------------------------------------------------------
 	// endian load/store
     // --------------------------------------------------------------
@@ -6,7 +6,11 @@
 
 #include <memory>
 #include <limits>
+#include <vector>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
 #include "configure.hpp"
 #include "object.hpp"
 
@@ -74,6 +78,8 @@ namespace detail {
         Memory m_memory;
         std::shared_ptr<u8> m_ptr;
 
+        friend class MemoryView;
+
     public:
         SharedMemory(size_t bytes);
         SharedMemory(u8* address, size_t bytes);
@@ -104,22 +110,151 @@ namespace detail {
         }
     };
 
+    // -----------------------------------------------------------------------
+    // MemoryView
+    // -----------------------------------------------------------------------
+
+    /*
+        MemoryView is a read-only view to memory which shares the ownership of the
+        memory. The views are cheap to copy and slice() returns a view which keeps the
+        same memory alive, so regions of a mapped file or a decoded buffer can be handed
+        to other threads and pipeline stages without copying them or keeping the
+        original owner around.
+
+        A view constructed from VirtualMemory* takes the ownership of the object; the
+        Mapper which created it must outlive the view. A view constructed from File
+        keeps the file and its mappers alive.
+
+        Usage example:
+
+        MemoryView view = File("data.zip/image.png");
+        MemoryView header = view.slice(0, 8);
+
+        queue.enqueue([header] {
+            process(header);
+        });
+
+    */
+
+    class Buffer;
+
+    class MemoryView
+    {
+    protected:
+        ConstMemory m_memory;
+        std::shared_ptr<const void> m_owner;
+
+    public:
+        MemoryView() = default;
+
+        // the memory is kept alive by the owner; a null owner creates a non-owning view
+        MemoryView(ConstMemory memory, std::shared_ptr<const void> owner)
+            : m_memory(memory)
+            , m_owner(std::move(owner))
+        {
+        }
+
+        MemoryView(std::shared_ptr<VirtualMemory> memory)
+            : m_memory(memory ? ConstMemory(*memory) : ConstMemory())
+            , m_owner(std::move(memory))
+        {
+        }
+
+        explicit MemoryView(std::unique_ptr<VirtualMemory> memory)
+            : MemoryView(std::shared_ptr<VirtualMemory>(std::move(memory)))
+        {
+        }
+
+        explicit MemoryView(VirtualMemory* memory)
+            : MemoryView(std::shared_ptr<VirtualMemory>(memory))
+        {
+        }
+
+        MemoryView(const SharedMemory& memory)
+            : m_memory(Memory(memory))
+            , m_owner(memory.m_ptr)
+        {
+        }
+
+        // the buffer is moved into the view; arena allocated buffers are copied
+        explicit MemoryView(Buffer&& buffer);
+
+        operator ConstMemory () const
+        {
+            return m_memory;
+        }
+
+        const ConstMemory* operator -> () const
+        {
+            return &m_memory;
+        }
+
+        const u8* data() const
+        {
+            return m_memory.address;
+        }
+
+        size_t size() const
+        {
+            return m_memory.size;
+        }
+
+        MemoryView slice(size_t offset, size_t size = 0) const
+        {
+            return MemoryView(m_memory.slice(offset, size), m_owner);
+        }
+
+        long use_count() const
+        {
+            return m_owner.use_count();
+        }
+    };
+
     // -----------------------------------------------------------------------
     // Alignment
     // -----------------------------------------------------------------------
 
     // NOTE: The alignment has to be a power-of-two and at least sizeof(void*)
 
+    /*
+        The allocation policy controls how aligned_malloc() backs large allocations:
+
+        HUGE_PAGES : the memory is mapped at huge page boundary and advised to use
+                     transparent huge pages (Linux: madvise MADV_HUGEPAGE)
+        HUGE_TLB   : explicit huge pages (Linux: mmap MAP_HUGETLB); falls back to
+                     HUGE_PAGES when the system has no huge pages reserved
+        PREFAULT   : the pages are touched in parallel in the ThreadPool before the
+                     memory is returned so that the first write does not page fault
+
+        The policy is a hint; unsupported policies are ignored.
+
+        Usage example:
+
+        Bitmap bitmap(16384, 16384, FORMAT_RGBA32F, 0, Alignment(64, Alignment::HUGE_PAGES | Alignment::PREFAULT));
+
+    */
+
     class Alignment
     {
+    public:
+        enum Policy : u32
+        {
+            DEFAULT    = 0x0,
+            HUGE_PAGES = 0x1,
+            HUGE_TLB   = 0x2,
+            PREFAULT   = 0x4,
+        };
+
     protected:
         u32 m_alignment;
+        u32 m_policy;
 
     public:
         Alignment(); // default alignment
-        Alignment(u32 alignment);
+        Alignment(u32 alignment, u32 policy = DEFAULT);
 
         operator u32 () const;
+        u32 policy() const;
     };
 
     // -----------------------------------------------------------------------
@@ -130,9 +265,9 @@ namespace detail {
     void aligned_free(void* aligned);
 
     template <typename T>
-    T* aligned_alloc(size_t size, u32 alignment)
+    T* aligned_alloc(size_t size, Alignment alignment)
     {
-        return reinterpret_cast<T*>(aligned_malloc(size * sizeof(T), Alignment(alignment)));
+        return reinterpret_cast<T*>(aligned_malloc(size * sizeof(T), alignment));
     }
 
     // -----------------------------------------------------------------------
@@ -174,4 +309,439 @@ namespace detail {
         }
     };
 
+    // -----------------------------------------------------------------------
+    // Arena
+    // -----------------------------------------------------------------------
+
+    /*
+        Arena is a monotonic allocator for transient memory. Allocation bumps an offset
+        in the current block and the memory is released all at once with reset() or by
+        rewinding to a marker. The blocks are kept for re-use; when the arena is reset
+        the blocks are consolidated so that after a warm-up the working set fits into a
+        single block and allocating does not touch the heap at all.
+
+        getThreadArena() returns an arena owned by the calling thread; every ThreadPool
+        worker has it's own so tasks can allocate scratch memory without locking.
+        ArenaScope releases the allocations made during it's lifetime; scopes on the
+        same arena must be nested. A reset arena keeps only a few MB for re-use, so
+        large allocations such as whole image buffers belong on the heap.
+
+        Usage example:
+
+        Arena& arena = getThreadArena();
+        ArenaScope scope(arena);
+
+        u8* temp = arena.allocate<u8>(bytes);
+        Buffer buffer(bytes, arena);
+
+    */
+
+    class Arena : private NonCopyable
+    {
+    public:
+        struct Marker
+        {
+            size_t block;
+            size_t offset;
+        };
+
+    protected:
+        struct Block
+        {
+            u8* data;
+            size_t size;
+        };
+
+        std::vector<Block> m_blocks;
+        size_t m_current;
+        size_t m_offset;
+        size_t m_block_size;
+
+        void consolidate();
+
+    public:
+        explicit Arena(size_t block_size = 64 * 1024);
+        ~Arena();
+
+        void* allocate(size_t bytes, Alignment alignment = Alignment());
+
+        template <typename T>
+        T* allocate(size_t count)
+        {
+            const u32 alignment = std::max(u32(alignof(T)), u32(sizeof(void*)));
+            return reinterpret_cast<T*>(allocate(count * sizeof(T), Alignment(alignment)));
+        }
+
+        Marker mark() const;
+        void rewind(Marker marker);
+        void reset();
+
+        size_t capacity() const;
+    };
+
+    class ArenaScope : private NonCopyable
+    {
+    protected:
+        Arena& m_arena;
+        Arena::Marker m_marker;
+
+    public:
+        ArenaScope(Arena& arena)
+            : m_arena(arena)
+            , m_marker(arena.mark())
+        {
+        }
+
+        ~ArenaScope()
+        {
+            m_arena.rewind(m_marker);
+        }
+    };
+
+    // arena owned by the calling thread
+    Arena& getThreadArena();
+
+    // -----------------------------------------------------------------------
+    // SlabAllocator
+    // -----------------------------------------------------------------------
+
+    /*
+        SlabAllocator is a thread-caching allocator for small fixed-size objects. Every
+        thread keeps a free list of blocks and allocating or releasing an object is a
+        push or pop on that list. When a free list runs empty or grows too long, blocks
+        are moved in batches between the thread and a global depot; the depot carves
+        new blocks from 64 KB slabs. Objects can be released by a different thread than
+        the one which allocated them. The slabs are never returned to the heap.
+
+        The pools are shared by types in the same size class (16 byte granularity) and
+        the statistics count the allocations of all of those types.
+
+        SlabObject<T> can be inherited to allocate T with new/delete from the slabs.
+
+        Usage example:
+
+        struct Node : SlabObject<Node>
+        {
+            Node* next;
+            int value;
+        };
+
+        Node* node = new Node(); // allocated from the calling thread's free list
+        delete node;
+
+        SlabStatistics stats = SlabAllocator<Node>::getStatistics();
+
+    */
+
+    struct SlabStatistics
+    {
+        u64 allocations;    // objects allocated
+        u64 deallocations;  // objects released
+        u64 slabs;          // slabs allocated from the heap
+        u64 exchanges;      // batches moved between thread caches and the depot
+    };
+
+namespace detail {
+
+    template <size_t BlockSize, size_t BlockAlign>
+    class SlabPool
+    {
+    protected:
+        struct Block
+        {
+            Block* next;
+        };
+
+        struct Batch
+        {
+            Block* head;
+            size_t count;
+        };
+
+        struct Cache
+        {
+            Block* head;
+            size_t count;
+            u64 allocations;
+            u64 deallocations;
+        };
+
+        struct Depot
+        {
+            std::mutex mutex;
+            std::vector<Batch> batches;
+            std::vector<void*> slabs;
+            std::atomic<u64> allocations { 0 };
+            std::atomic<u64> deallocations { 0 };
+            std::atomic<u64> exchanges { 0 };
+        };
+
+        struct CacheOwner
+        {
+            Cache cache { nullptr, 0, 0, 0 };
+
+            ~CacheOwner()
+            {
+                // the thread is exiting; hand the free list to other threads
+                flush(cache, cache.count);
+                destroyed() = true;
+            }
+        };
+
+        static const size_t batch_size = 64;
+        static const size_t slab_size = BlockSize * batch_size > 64 * 1024 ? BlockSize * batch_size : 64 * 1024;
+
+        static Depot& depot()
+        {
+            // never destroyed; objects can be released during static destruction
+            static Depot* instance = new Depot();
+            return *instance;
+        }
+
+        static bool& destroyed()
+        {
+            static thread_local bool value = false;
+            return value;
+        }
+
+        static Cache* cache()
+        {
+            if (destroyed())
+            {
+                return nullptr;
+            }
+
+            static thread_local CacheOwner owner;
+            return &owner.cache;
+        }
+
+        static void publish(Depot& depot, Cache& cache)
+        {
+            depot.allocations.fetch_add(cache.allocations, std::memory_order_relaxed);
+            depot.deallocations.fetch_add(cache.deallocations, std::memory_order_relaxed);
+            cache.allocations = 0;
+            cache.deallocations = 0;
+        }
+
+        static void refill(Cache& cache)
+        {
+            Depot& d = depot();
+            publish(d, cache);
+
+            std::lock_guard<std::mutex> lock(d.mutex);
+            d.exchanges.fetch_add(1, std::memory_order_relaxed);
+
+            if (d.batches.empty())
+            {
+                // carve a new slab into batches
+                u8* slab = reinterpret_cast<u8*>(aligned_malloc(slab_size, Alignment(BlockAlign)));
+                if (!slab)
+                {
+                    throw std::bad_alloc();
+                }
+
+                d.slabs.push_back(slab);
+
+                const size_t count = slab_size / BlockSize;
+                for (size_t i = 0; i < count; i += batch_size)
+                {
+                    const size_t n = std::min(batch_size, count - i);
+                    Block* head = nullptr;
+
+                    for (size_t j = i + n; j-- > i; )
+                    {
+                        Block* block = reinterpret_cast<Block*>(slab + j * BlockSize);
+                        block->next = head;
+                        head = block;
+                    }
+
+                    d.batches.push_back({ head, n });
+                }
+            }
+
+            Batch batch = d.batches.back();
+            d.batches.pop_back();
+
+            cache.head = batch.head;
+            cache.count = batch.count;
+        }
+
+        static void flush(Cache& cache, size_t count)
+        {
+            Depot& d = depot();
+            publish(d, cache);
+
+            while (count > 0)
+            {
+                const size_t n = std::min(count, batch_size);
+
+                Block* head = cache.head;
+                Block* tail = head;
+                for (size_t i = 1; i < n; ++i)
+                {
+                    tail = tail->next;
+                }
+
+                cache.head = tail->next;
+                cache.count -= n;
+                tail->next = nullptr;
+                count -= n;
+
+                std::lock_guard<std::mutex> lock(d.mutex);
+                d.batches.push_back({ head, n });
+                d.exchanges.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+    public:
+        static void* allocate()
+        {
+            Cache* c = cache();
+            if (!c)
+            {
+                // the thread cache is gone; go through the depot
+                Cache temp { nullptr, 0, 1, 0 };
+                refill(temp);
+                Block* block = temp.head;
+                temp.head = block->next;
+                flush(temp, temp.count - 1);
+                return block;
+            }
+
+            if (!c->head)
+            {
+                refill(*c);
+            }
+
+            Block* block = c->head;
+            c->head = block->next;
+            --c->count;
+            ++c->allocations;
+            return block;
+        }
+
+        static void deallocate(void* ptr)
+        {
+            Block* block = reinterpret_cast<Block*>(ptr);
+
+            Cache* c = cache();
+            if (!c)
+            {
+                Cache temp { block, 1, 0, 1 };
+                block->next = nullptr;
+                flush(temp, 1);
+                return;
+            }
+
+            block->next = c->head;
+            c->head = block;
+            ++c->count;
+            ++c->deallocations;
+
+            if (c->count >= batch_size * 2)
+            {
+                flush(*c, batch_size);
+            }
+        }
+
+        static SlabStatistics getStatistics()
+        {
+            Depot& d = depot();
+
+            SlabStatistics stats;
+            stats.allocations = d.allocations.load(std::memory_order_relaxed);
+            stats.deallocations = d.deallocations.load(std::memory_order_relaxed);
+            stats.exchanges = d.exchanges.load(std::memory_order_relaxed);
+
+            // the calling thread's counters which have not been published yet
+            if (Cache* c = cache())
+            {
+                stats.allocations += c->allocations;
+                stats.deallocations += c->deallocations;
+            }
+
+            std::lock_guard<std::mutex> lock(d.mutex);
+            stats.slabs = d.slabs.size();
+            return stats;
+        }
+    };
+
+    template <size_t BlockSize, size_t BlockAlign>
+    const size_t SlabPool<BlockSize, BlockAlign>::batch_size;
+
+    template <size_t BlockSize, size_t BlockAlign>
+    const size_t SlabPool<BlockSize, BlockAlign>::slab_size;
+
+} // namespace detail
+
+    template <typename T>
+    class SlabAllocator
+    {
+    protected:
+        static const size_t align = alignof(T) > 16 ? alignof(T) : 16;
+        static const size_t size = (sizeof(T) + align - 1) & ~(align - 1);
+
+        using Pool = detail::SlabPool<size, align>;
+
+    public:
+        static void* allocate()
+        {
+            return Pool::allocate();
+        }
+
+        static void deallocate(void* ptr)
+        {
+            Pool::deallocate(ptr);
+        }
+
+        template <typename... Args>
+        static T* create(Args&&... args)
+        {
+            void* ptr = Pool::allocate();
+            try
+            {
+                return new (ptr) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                Pool::deallocate(ptr);
+                throw;
+            }
+        }
+
+        static void destroy(T* object)
+        {
+            if (object)
+            {
+                object->~T();
+                Pool::deallocate(object);
+            }
+        }
+
+        static SlabStatistics getStatistics()
+        {
+            return Pool::getStatistics();
+        }
+    };
+
+    template <typename T>
+    struct SlabObject
+    {
+        static void* operator new (size_t size)
+        {
+            // derived types which do not fit into the slab block use the heap
+            if (size > sizeof(T))
+                return ::operator new(size);
+            return SlabAllocator<T>::allocate();
+        }
+
+        static void operator delete (void* ptr, size_t size)
+        {
+            if (size > sizeof(T))
+                ::operator delete(ptr);
+            else
+                SlabAllocator<T>::deallocate(ptr);
+        }
+    };
+
 } // namespace mango
@@ -166,6 +166,32 @@ namespace detail {
             p += 8;
             return value;
         }
+
+        // bulk read functions
+
+        void read16_array(u16* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * sizeof(u16));
+            p += count * sizeof(u16);
+        }
+
+        void read32_array(u32* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * sizeof(u32));
+            p += count * sizeof(u32);
+        }
+
+        void read64_array(u64* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * sizeof(u64));
+            p += count * sizeof(u64);
+        }
+
+        void read_f32_array(float* dest, size_t count)
+        {
+            std::memcpy(dest, p, count * sizeof(float));
+            p += count * sizeof(float);
+        }
     };
 
     // --------------------------------------------------------------
@@ -331,6 +357,32 @@ namespace detail {
             p += 8;
             return value;
         }
+
+        // bulk read functions
+
+        void read16_array(u16* dest, size_t count)
+        {
+            byteswap16_array(dest, p, count);
+            p += count * sizeof(u16);
+        }
+
+        void read32_array(u32* dest, size_t count)
+        {
+            byteswap32_array(dest, p, count);
+            p += count * sizeof(u32);
+        }
+
+        void read64_array(u64* dest, size_t count)
+        {
+            byteswap64_array(dest, p, count);
+            p += count * sizeof(u64);
+        }
+
+        void read_f32_array(float* dest, size_t count)
+        {
+            byteswap32_array(reinterpret_cast<u32*>(dest), p, count);
+            p += count * sizeof(float);
+        }
     };
 
     // --------------------------------------------------------------
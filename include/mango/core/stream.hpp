@@ -130,6 +130,28 @@ namespace mango
             return value;
         }
 
+        // bulk read functions
+
+        void read16_array(u16* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u16));
+        }
+
+        void read32_array(u32* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u32));
+        }
+
+        void read64_array(u64* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u64));
+        }
+
+        void read_f32_array(float* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(float));
+        }
+
         // write functions
 
         void write(const void* data, size_t size)
@@ -268,6 +290,32 @@ namespace mango
             return value;
         }
 
+        // bulk read functions: the values are read with one call and swapped in-place
+
+        void read16_array(u16* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u16));
+            byteswap16_array(dest, dest, count);
+        }
+
+        void read32_array(u32* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u32));
+            byteswap32_array(dest, dest, count);
+        }
+
+        void read64_array(u64* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(u64));
+            byteswap64_array(dest, dest, count);
+        }
+
+        void read_f32_array(float* dest, size_t count)
+        {
+            s.read(dest, count * sizeof(float));
+            byteswap32_array(reinterpret_cast<u32*>(dest), reinterpret_cast<u32*>(dest), count);
+        }
+
         // write functions
 
         void write(const void* data, size_t size)
@@ -7,6 +7,8 @@
 #include <string>
 #include <vector>
 #include <cstdarg>
+#include <cstring>
+#include <algorithm>
 #include "configure.hpp"
 
 namespace mango
@@ -23,16 +25,124 @@ namespace mango
     std::string u16_toBytes(const std::wstring& source);
     std::wstring u16_fromBytes(const std::string& source);
 
+    // -----------------------------------------------------------------
+    // StringView
+    // -----------------------------------------------------------------
+
+    /*
+        StringView is a non-owning reference to a sequence of characters; it is used
+        to pass substrings around without allocating temporary std::string objects
+        (std::string_view is not available in C++14). The referenced characters must
+        outlive the view.
+    */
+
+    class StringView
+    {
+    protected:
+        const char* m_data;
+        size_t m_size;
+
+    public:
+        static const size_t npos = size_t(-1);
+
+        StringView()
+            : m_data("")
+            , m_size(0)
+        {
+        }
+
+        StringView(const char* s)
+            : m_data(s)
+            , m_size(std::strlen(s))
+        {
+        }
+
+        StringView(const char* s, size_t size)
+            : m_data(s)
+            , m_size(size)
+        {
+        }
+
+        StringView(const std::string& s)
+            : m_data(s.data())
+            , m_size(s.length())
+        {
+        }
+
+        operator std::string () const
+        {
+            return std::string(m_data, m_size);
+        }
+
+        const char* data() const
+        {
+            return m_data;
+        }
+
+        size_t size() const
+        {
+            return m_size;
+        }
+
+        size_t length() const
+        {
+            return m_size;
+        }
+
+        bool empty() const
+        {
+            return m_size == 0;
+        }
+
+        const char* begin() const
+        {
+            return m_data;
+        }
+
+        const char* end() const
+        {
+            return m_data + m_size;
+        }
+
+        char operator [] (size_t index) const
+        {
+            return m_data[index];
+        }
+
+        StringView substr(size_t offset, size_t count = npos) const
+        {
+            offset = std::min(offset, m_size);
+            return StringView(m_data + offset, std::min(count, m_size - offset));
+        }
+
+        bool operator == (StringView other) const
+        {
+            return m_size == other.m_size && !std::memcmp(m_data, other.m_data, m_size);
+        }
+
+        bool operator != (StringView other) const
+        {
+            return !(*this == other);
+        }
+    };
+
     // string utilities
-    std::string toLower(std::string s);
-    std::string toUpper(std::string s);
+    std::string toLower(StringView s);
+    std::string toUpper(StringView s);
     std::string removePrefix(const std::string& s, const std::string& prefix);
-    bool isPrefix(const std::string& s, const std::string& prefix);
+    bool isPrefix(StringView s, StringView prefix);
     void replace(std::string& s, const std::string& from, const std::string& to);
-    std::vector<std::string> split(const std::string& s, char delimiter);
-    std::vector<std::string> split(const std::string& s, const char* delimiter);
-    std::vector<std::string> split(const std::string& s, const std::string& delimiter);
+    std::vector<std::string> split(StringView s, char delimiter);
+    std::vector<std::string> split(StringView s, const char* delimiter);
+    std::vector<std::string> split(StringView s, const std::string& delimiter);
+    std::vector<StringView> splitView(StringView s, char delimiter);
     std::string makeString(const char* format, ...);
+
+    // position of the first / last character in s which is in the set; npos if none
+    size_t findFirstOf(StringView s, StringView set);
+    size_t findLastOf(StringView s, StringView set);
+
+    // returns p + count if the value is not found
     const u8* memchr(const u8* p, u8 value, size_t count);
 
 } // namespace mango
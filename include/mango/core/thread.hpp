@@ -4,7 +4,9 @@
 */
 #pragma once
 
+#include <algorithm>
 #include <queue>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <thread>
@@ -12,27 +14,309 @@
 #include <functional>
 #include <condition_variable>
 #include <future>
+#include <type_traits>
 #include "exception.hpp"
 #include "object.hpp"
 #include "atomic.hpp"
+#include "timer.hpp"
+#include "memory.hpp"
 
 namespace mango
 {
 
+    // ----------------------------------------------------------------------------------
+    // TaskFunction
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskFunction is a move-only void() callable with inline storage. Callables which
+        fit into the storage and can be moved without exceptions are stored in-place and
+        submitting them into the ThreadPool does not allocate memory; larger callables
+        are allocated from the thread-caching SlabAllocator.
+    */
+
+    class TaskFunction
+    {
+    public:
+        enum { STORAGE_SIZE = 48 };
+
+    private:
+        struct Operations
+        {
+            void (*invoke)(void* storage);
+            void (*move)(void* dest, void* source);
+            void (*destroy)(void* storage);
+        };
+
+        template <typename F>
+        struct InlineOperations
+        {
+            static void invoke(void* storage)
+            {
+                (*reinterpret_cast<F*>(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                F* func = reinterpret_cast<F*>(source);
+                new (dest) F(std::move(*func));
+                func->~F();
+            }
+
+            static void destroy(void* storage)
+            {
+                reinterpret_cast<F*>(storage)->~F();
+            }
+
+            static const Operations* get()
+            {
+                static const Operations operations = { invoke, move, destroy };
+                return &operations;
+            }
+        };
+
+        template <typename F>
+        struct HeapOperations
+        {
+            static void invoke(void* storage)
+            {
+                (**reinterpret_cast<F**>(storage))();
+            }
+
+            static void move(void* dest, void* source)
+            {
+                *reinterpret_cast<F**>(dest) = *reinterpret_cast<F**>(source);
+            }
+
+            static void destroy(void* storage)
+            {
+                SlabAllocator<F>::destroy(*reinterpret_cast<F**>(storage));
+            }
+
+            static const Operations* get()
+            {
+                static const Operations operations = { invoke, move, destroy };
+                return &operations;
+            }
+        };
+
+        template <typename F>
+        struct IsInline
+        {
+            enum
+            {
+                value = sizeof(F) <= STORAGE_SIZE &&
+                        alignof(F) <= alignof(void*) &&
+                        std::is_nothrow_move_constructible<F>::value
+            };
+        };
+
+        const Operations* m_operations;
+        alignas(void*) u8 m_storage[STORAGE_SIZE];
+
+        template <typename F>
+        void construct(F&& func, std::true_type)
+        {
+            using T = typename std::decay<F>::type;
+            new (m_storage) T(std::forward<F>(func));
+            m_operations = InlineOperations<T>::get();
+        }
+
+        template <typename F>
+        void construct(F&& func, std::false_type)
+        {
+            using T = typename std::decay<F>::type;
+            *reinterpret_cast<T**>(m_storage) = SlabAllocator<T>::create(std::forward<F>(func));
+            m_operations = HeapOperations<T>::get();
+        }
+
+    public:
+        TaskFunction()
+            : m_operations(nullptr)
+        {
+        }
+
+        template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, TaskFunction>::value>::type>
+        TaskFunction(F&& func)
+            : m_operations(nullptr)
+        {
+            using T = typename std::decay<F>::type;
+            construct(std::forward<F>(func), std::integral_constant<bool, IsInline<T>::value>());
+        }
+
+        TaskFunction(TaskFunction&& other) noexcept
+            : m_operations(other.m_operations)
+        {
+            if (m_operations)
+            {
+                m_operations->move(m_storage, other.m_storage);
+                other.m_operations = nullptr;
+            }
+        }
+
+        TaskFunction& operator = (TaskFunction&& other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                m_operations = other.m_operations;
+                if (m_operations)
+                {
+                    m_operations->move(m_storage, other.m_storage);
+                    other.m_operations = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        TaskFunction(const TaskFunction&) = delete;
+        TaskFunction& operator = (const TaskFunction&) = delete;
+
+        ~TaskFunction()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            if (m_operations)
+            {
+                m_operations->destroy(m_storage);
+                m_operations = nullptr;
+            }
+        }
+
+        explicit operator bool () const
+        {
+            return m_operations != nullptr;
+        }
+
+        void operator () ()
+        {
+            m_operations->invoke(m_storage);
+        }
+    };
+
+    // ----------------------------------------------------------------------------------
+    // ThreadPoolStatistics
+    // ----------------------------------------------------------------------------------
+
+    /*
+        ThreadPool instrumentation is compiled in with MANGO_ENABLE_THREAD_INSTRUMENTATION
+        (cmake: ENABLE_THREAD_INSTRUMENTATION). When it is disabled nothing is recorded and
+        the snapshot is empty.
+
+        Usage example:
+
+        ThreadPool& pool = ThreadPool::getInstance();
+        pool.setTrace(true);
+
+        // TODO: do your stuff here..
+
+        ThreadPoolStatistics stats = pool.getStatistics();
+        for (auto& queue : stats.queues)
+        {
+            printf("%s: %d tasks, p99 wait: %d ns\n", queue.name.c_str(),
+                int(queue.dequeued), int(queue.latency.percentile(0.99)));
+        }
+
+        // chrome://tracing or https://ui.perfetto.dev
+        std::string json = pool.getChromeTrace();
+
+    */
+
+    struct ThreadPoolStatistics
+    {
+        struct Histogram
+        {
+            // bins[i] counts the samples in [2^i, 2^(i+1)) nanoseconds
+            u64 bins[32] = { 0 };
+            u64 count = 0;
+            u64 total_ns = 0;
+
+            // upper bound of the bin where the percentile (0.0 .. 1.0) falls
+            u64 percentile(double p) const;
+        };
+
+        struct Queue
+        {
+            std::string name;
+            int priority = 0;
+            u64 enqueued = 0;
+            u64 dequeued = 0;
+            u64 wait_calls = 0;   // calls to wait() on the queue
+            u64 wait_ns = 0;      // time spent blocked in wait()
+            Histogram latency;    // time from enqueue to start of execution
+            Histogram runtime;    // task execution time
+        };
+
+        struct Worker
+        {
+            u64 tasks = 0;
+            u64 busy_ns = 0;      // executing tasks
+            u64 idle_ns = 0;      // looking for work, including parked time
+            u64 parked_ns = 0;    // sleeping on the pool condition variable
+        };
+
+        u64 elapsed_ns = 0;       // lifetime of the pool
+        std::vector<Queue> queues;
+        std::vector<Worker> workers;
+        Worker external;          // tasks executed by threads helping in wait()
+    };
+
+namespace detail
+{
+
+    template <typename F>
+    struct ParallelFor;
+
+} // namespace detail
+
     // ----------------------------------------------------------------------------------
     // ThreadPool
     // ----------------------------------------------------------------------------------
 
+    /*
+        Every worker thread owns a task deque per priority level. Tasks enqueued from a
+        worker go into it's own deque and are processed in LIFO order by the owner; tasks
+        enqueued from outside of the pool are distributed between the workers. When a
+        worker runs out of work it steals the oldest tasks (FIFO) from the other workers.
+
+        Idle workers poll for a limited number of rounds (the spin budget) and then park
+        on an event count; enqueue() only has to signal when there are parked workers and
+        the signal cannot be lost between a worker's last check and going to sleep.
+
+        The workers are not pinned to processors by default. A pool can be created with
+        Affinity::CORE to pin each worker to a logical processor, one physical core at a
+        time, or with Affinity::CACHE to pin workers to the processors sharing a L3 cache.
+        Pinned pools know the NUMA node of each worker so that queues can prefer a node.
+
+        The topology-aware affinity is Linux only since the topology is only known there
+        (see getCPUTopology). On other platforms Affinity::CORE pins the workers to the
+        logical processors in order without spreading them across physical cores, and
+        Affinity::CACHE sees a single cache domain so the workers are not restricted.
+    */
+
     class ThreadPool : private NonCopyable
     {
     private:
         friend class ConcurrentQueue;
+        friend class SerialQueue;
+        friend class TaskGraph;
+        template <typename F> friend struct detail::ParallelFor;
         using CacheLine = u8[64];
 
+        // NOTE: The instrumentation state is always part of the layout so that code
+        //       compiled with and without MANGO_ENABLE_THREAD_INSTRUMENTATION is
+        //       binary compatible; the define is private to the library.
+        struct Counters;
+
         struct Queue
         {
             ThreadPool* pool;
             int priority;
+            int node;
             std::string name;
 
 #if 0 // __cplusplus >= 201703L
@@ -53,22 +337,39 @@ namespace mango
 
 #endif
 
-            Queue(ThreadPool* pool, int priority, const std::string& name)
+            Counters* counters = nullptr;
+
+            Queue(ThreadPool* pool, int priority, const std::string& name, int node = -1)
                 : pool(pool)
                 , priority(priority)
+                , node(node)
                 , name(name)
             {
+                pool->attach(this);
+            }
+
+            ~Queue()
+            {
+                pool->detach(this);
             }
         };
 
         struct Task
         {
             Queue* queue;
-            std::function<void()> func;
+            TaskFunction func;
+            u64 time = 0; // enqueue timestamp (instrumentation)
         };
 
     public:
-        ThreadPool(size_t size);
+        enum class Affinity
+        {
+            NONE,   // let the OS scheduler place the workers
+            CORE,   // pin each worker to one logical processor, spread across physical cores
+            CACHE   // pin each worker to the processors sharing a L3 cache domain
+        };
+
+        ThreadPool(size_t size, Affinity affinity = Affinity::NONE);
         ~ThreadPool();
 
         static ThreadPool& getInstance();
@@ -76,16 +377,41 @@ namespace mango
 
         int size() const;
 
-        void enqueue(std::function<void()>&& func)
+        // NUMA node of the worker; -1 when the pool is not pinned
+        int getWorkerNode(size_t worker) const;
+
+        // number of polling rounds an idle worker does before it is parked
+        void setSpinBudget(int rounds);
+        int getSpinBudget() const;
+
+        // number of times a parked worker was woken up and found nothing to do
+        u64 getSpuriousWakeups() const;
+
+        template <typename F>
+        void enqueue(F&& func)
         {
-            enqueue(&m_static_queue, std::move(func));
+            enqueue(&m_static_queue, TaskFunction(std::forward<F>(func)));
         }
 
+        // snapshot of the instrumentation counters
+        ThreadPoolStatistics getStatistics() const;
+
+        // record executed tasks into a per-worker ring of capacity events
+        void setTrace(bool enable, size_t capacity = 65536);
+
+        // recorded trace in the Chrome trace event JSON format
+        std::string getChromeTrace() const;
+
     protected:
         void thread(size_t threadID);
+        void park(u32 epoch);
+        void unpark(size_t count = 1);
+        size_t select(Queue* queue);
 
-        void enqueue(Queue* queue, std::function<void()>&& func);
+        void enqueue(Queue* queue, TaskFunction&& func);
+        void enqueue_bulk(Queue* queue, TaskFunction* funcs, size_t count);
         bool dequeue_and_process();
+        void process(Task& task);
         void cancel(Queue* queue);
         void wait(Queue* queue);
 
@@ -94,14 +420,42 @@ namespace mango
 
         struct TaskQueue;
         alignas(64) TaskQueue* m_queues;
+        size_t m_queue_count;
 
         alignas(64) std::atomic<bool> m_stop { false };
         alignas(64) std::atomic<int> m_sleep_count { 0 };
+        std::atomic<u32> m_epoch { 0 };
         std::mutex m_queue_mutex;
         std::condition_variable m_condition;
 
+        alignas(64) std::atomic<int> m_spin_budget { 64 };
+        std::atomic<u64> m_spurious_wakeups { 0 };
+
+        std::vector<std::vector<int>> m_processors; // per worker affinity
+        std::vector<int> m_worker_node;
+        std::vector<std::vector<size_t>> m_node_workers;
+
+        // instrumentation
+        struct WorkerCounters;
+        WorkerCounters* m_worker_counters = nullptr; // workers + external
+        u64 m_start_time = 0;
+
+        mutable std::mutex m_instrument_mutex;
+        std::vector<Queue*> m_attached;
+        std::vector<ThreadPoolStatistics::Queue> m_retired;
+        std::vector<std::string> m_names;
+        std::atomic<bool> m_trace { false };
+
+        void attach(Queue* queue);
+        void detach(Queue* queue);
+        void record(const Task& task, u64 start, u64 end);
+        void record_wait(Queue* queue, u64 start, u64 end);
+
         Queue m_static_queue;
+        Queue m_parallel_queue; // shared by the parallel loops
         std::vector<std::thread> m_threads;
+
+        void configure(Affinity affinity);
     };
 
     enum class Priority
@@ -147,12 +501,53 @@ namespace mango
     public:
         ConcurrentQueue();
         ConcurrentQueue(const std::string& name, Priority priority = Priority::NORMAL);
+
+        // tasks prefer workers on the given NUMA node when the pool is pinned
+        ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority = Priority::NORMAL, int node = -1);
         ~ConcurrentQueue();
 
+        template <class F>
+        void enqueue(F&& f)
+        {
+            m_pool.enqueue(&m_queue, TaskFunction(std::forward<F>(f)));
+        }
+
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            m_pool.enqueue(&m_queue, std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+            m_pool.enqueue(&m_queue, TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
+        }
+
+        // split [begin, end) into tasks of at most grain indices; func(first, last) is
+        // called for each task with a half-open sub-range. The func is copied into each task.
+        template <class F>
+        void enqueue_range(size_t begin, size_t end, size_t grain, F&& func)
+        {
+            enum { BATCH = 32 };
+            TaskFunction batch[BATCH];
+            size_t count = 0;
+
+            grain = std::max(grain, size_t(1));
+
+            for (size_t first = begin; first < end; )
+            {
+                size_t last = first + std::min(grain, end - first);
+
+                batch[count++] = TaskFunction([func, first, last] () mutable
+                {
+                    func(first, last);
+                });
+
+                if (count == BATCH)
+                {
+                    m_pool.enqueue_bulk(&m_queue, batch, count);
+                    count = 0;
+                }
+
+                first = last;
+            }
+
+            m_pool.enqueue_bulk(&m_queue, batch, count);
         }
 
         void steal();
@@ -160,14 +555,95 @@ namespace mango
         void wait();
     };
 
+    // ----------------------------------------------------------------------------------
+    // TaskGraph
+    // ----------------------------------------------------------------------------------
+
+    /*
+        TaskGraph is API to submit tasks with dependencies into the ThreadPool. Each node
+        keeps a list of successors and an atomic counter of unfinished predecessors; a node
+        is released into the ThreadPool the moment the last of it's predecessors has
+        completed so no worker is ever blocked waiting for inputs. The graph is built first
+        and then submitted; a completed graph can be submitted again.
+
+        Usage example:
+
+        TaskGraph graph;
+
+        auto decode = graph.add([] { ... });
+        auto convert = graph.add([] { ... });
+        auto compress = graph.add([] { ... });
+        auto write = graph.add([] { ... });
+
+        graph.precede(decode, convert);
+        graph.precede(convert, compress);
+        graph.precede(compress, write);
+
+        graph.submit();
+
+        // wait until the whole graph is completed
+        graph.wait(); // cooperative, blocking (helps pool until all tasks are complete)
+
+    */
+
+    class TaskGraph : private NonCopyable
+    {
+    public:
+        struct Node : SlabObject<Node>
+        {
+            TaskFunction func;
+            std::vector<Node*> successors;
+            std::atomic<int> pending { 0 };
+            int predecessors { 0 };
+        };
+
+    protected:
+        ThreadPool& m_pool;
+        ThreadPool::Queue m_queue;
+        std::vector<std::unique_ptr<Node>> m_nodes;
+
+        void release(Node* node);
+
+    public:
+        TaskGraph();
+        TaskGraph(const std::string& name, Priority priority = Priority::NORMAL);
+        ~TaskGraph();
+
+        template <class F>
+        Node* add(F&& f)
+        {
+            m_nodes.emplace_back(new Node());
+            Node* node = m_nodes.back().get();
+            node->func = TaskFunction(std::forward<F>(f));
+            return node;
+        }
+
+        template <class F, class... Args>
+        Node* add(F&& f, Args&&... args)
+        {
+            return add(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        }
+
+        // the "after" node will not be started before the "before" node has completed
+        void precede(Node* before, Node* after);
+
+        void submit();
+        void cancel();
+        void wait();
+    };
+
     // ----------------------------------------------------------------------------------
     // SerialQueue
     // ----------------------------------------------------------------------------------
 
     /*
         SerialQueue is API to serialize tasks to be executed after previous task
-        in the queue has completed. The tasks are NOT executed in the ThreadPool; each
-        queue has it's own execution thread.
+        in the queue has completed. By default the tasks are executed in the ThreadPool
+        one at a time, in the order they were submitted; the queue does not own a thread.
+        Executor::THREAD gives the queue it's own execution thread instead.
+
+        The tasks are submitted into a lock-free list; submitting into a queue which
+        is already executing does not take a lock or wake up any threads.
 
         SerialQueue and ConcurrentQueue can be freely mixed can can enqueue work to other
         queues from their tasks.
@@ -184,57 +660,76 @@ namespace mango
         });
 
         // wait until the queue is drained
-        s.wait(); // non-cooperative, blocking (CPU sleeps until queue is drained)
+        s.wait();
 
     */
 
     class SerialQueue : private NonCopyable
     {
+    public:
+        enum class Executor
+        {
+            POOL,   // tasks are executed in the ThreadPool
+            THREAD  // tasks are executed in a thread owned by the queue
+        };
+
     protected:
-        using Task = std::function<void()>;
         using CacheLine = u8[64];
 
-        std::string m_name;
-        std::thread m_thread;
-
-#if 0 // __cplusplus >= 201703L
+        struct Node : SlabObject<Node>
+        {
+            std::atomic<Node*> next { nullptr };
+            u64 sequence = 0;
+            TaskFunction func;
+        };
 
-        // NOTE: When the minimum requirement is C++17 we will use this form so that
-        //       the heap allocations will be properly aligned. We won't compile both versions
-        //       based on the _ cplusplus macro as that would break binary compatibility between
-        //       code compiled against different C++ standard version.
+        std::string m_name;
+        Executor m_executor;
+        ThreadPool& m_pool;
+        ThreadPool::Queue m_queue;
 
-        alignas(64) std::atomic<bool> m_stop { false };
-        alignas(64) std::atomic<int> m_task_counter { 0 };
+        // consumer end of the task list; only accessed by the executing task
+        Node* m_head;
+        CacheLine padding0;
 
-#else
+        // producer end of the task list
+        std::atomic<Node*> m_tail;
+        std::atomic<u64> m_sequence { 0 };
+        CacheLine padding1;
 
-        std::atomic<bool> m_stop { false };
-        CacheLine padding;
+        // number of submitted tasks which have not completed yet; the producer which
+        // moves the counter from zero schedules the execution
         std::atomic<int> m_task_counter { 0 };
+        std::atomic<u64> m_cancelled { 0 };
 
-#endif
-
-        std::deque<Task> m_task_queue;
-        std::mutex m_queue_mutex;
-        std::mutex m_wait_mutex;
+        // Executor::THREAD
+        std::thread m_thread;
+        std::atomic<bool> m_stop { false };
+        std::mutex m_mutex;
         std::condition_variable m_task_condition;
         std::condition_variable m_wait_condition;
 
+        void push(TaskFunction&& func);
+        void schedule();
+        bool drain(size_t limit);
         void thread();
 
     public:
         SerialQueue();
-        SerialQueue(const std::string& name);
+        SerialQueue(const std::string& name, Executor executor = Executor::POOL);
+        SerialQueue(ThreadPool& pool, const std::string& name);
         ~SerialQueue();
 
+        template <class F>
+        void enqueue(F&& f)
+        {
+            push(TaskFunction(std::forward<F>(f)));
+        }
+
         template <class F, class... Args>
         void enqueue(F&& f, Args&&... args)
         {
-            std::unique_lock<std::mutex> lock(m_queue_mutex);
-            m_task_queue.emplace_back(f, (args)...);
-            ++m_task_counter;
-            m_task_condition.notify_one();
+            push(TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...)));
         }
 
         void cancel();
@@ -282,39 +777,71 @@ namespace mango
     class TicketQueue : private NonCopyable
     {
     protected:
-        struct Task
+        // The tickets are allocated from segments of consecutive slots; the queue grows
+        // by linking a new segment when more tickets are outstanding than fit into the
+        // existing segments so acquire() never blocks. A slot is released when it has
+        // been executed AND the last Ticket referencing it has been destroyed. The
+        // segment is recycled when all of it's slots have been released and the
+        // consumer has moved past it.
+        struct Segment;
+
+        struct Slot
         {
-            std::atomic<int> count { 1 };
-            std::function<void()> func;
-            std::promise<void> promise;
+            Segment* segment = nullptr;
+            std::atomic<bool> ready { false }; // consumed, ready to be executed
+            std::atomic<int> count { 0 };      // Ticket references
+            std::atomic<int> owners { 0 };     // Ticket references + execution
+            TaskFunction func;
         };
 
-    public:
-        using SharedTask = std::shared_ptr<Task>;
+        struct Segment
+        {
+            std::atomic<u64> base { 0 };
+            std::atomic<Segment*> next { nullptr };
+            std::atomic<size_t> owners { 0 }; // unreleased slots + consumer
+            Slot* slots;
+        };
 
+    public:
         class Ticket
         {
         protected:
             friend class TicketQueue;
 
-            SharedTask task;
+            TicketQueue* queue = nullptr;
+            Slot* slot = nullptr;
+            u64 sequence = 0;
+
+            Ticket(TicketQueue* queue, Slot* slot, u64 sequence);
+            void release();
 
         public:
-            Ticket();
+            Ticket() = default;
             ~Ticket();
 
             Ticket(const Ticket& ticket);
+            Ticket(Ticket&& ticket) noexcept;
             const Ticket& operator = (const Ticket& ticket);
+            const Ticket& operator = (Ticket&& ticket) noexcept;
+
+            template <class F>
+            void consume(F&& f) const
+            {
+                slot->func = TaskFunction(std::forward<F>(f));
+                queue->ready(slot, sequence);
+            }
 
             template <class F, class... Args>
             void consume(F&& f, Args&&... args) const
             {
-                task->func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-                task->promise.set_value();
+                slot->func = TaskFunction(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+                queue->ready(slot, sequence);
             }
         };
 
-        TicketQueue();
+        // capacity is the number of tickets in a segment; the queue grows by a
+        // segment at a time when more tickets are outstanding
+        TicketQueue(size_t capacity = 1024);
         ~TicketQueue();
 
         Ticket acquire();
@@ -323,17 +850,34 @@ namespace mango
     protected:
         std::thread m_thread;
 
-        alignas(64) std::atomic<bool> m_stop { false };
-        alignas(64) std::atomic<int> m_ticket_counter { 0 };
+        size_t m_capacity;
+
+        alignas(64) std::atomic<u64> m_acquire_cursor { 0 };
+        std::atomic<Segment*> m_acquire_segment { nullptr };
+
+        alignas(64) std::atomic<u64> m_consume_cursor { 0 };
+        Segment* m_consume_segment = nullptr;
+        std::atomic<bool> m_sleeping { false };
+        std::atomic<bool> m_stop { false };
 
-        std::mutex m_wait_mutex;
-        std::mutex m_consume_mutex;
+        alignas(64) std::atomic<u64> m_outstanding { 0 }; // unreleased slots
+
+        std::mutex m_mutex;
         std::condition_variable m_wait_condition;
         std::condition_variable m_consume_condition;
 
-        struct TaskQueue;
-        alignas(64) TaskQueue* m_queue;
+        std::mutex m_segment_mutex;
+        std::vector<Segment*> m_segments; // live segments in sequence order
+        std::vector<Segment*> m_free_segments;
+        u64 m_next_base = 0;
+
+        Segment* create_segment();
+        Segment* get_segment(u64 sequence);
+        void release_segment(Segment* segment);
+        Slot* consume_slot(u64 sequence);
 
+        void ready(Slot* slot, u64 sequence);
+        void recycle(Slot* slot);
         bool dequeue_and_process();
     };
 
@@ -385,7 +929,6 @@ namespace mango
     private:
         using Future = std::future<T>;
         using Promise = std::promise<T>;
-        using Function = std::function<T()>;
 
         Promise m_promise;
         Future m_future;
@@ -396,14 +939,14 @@ namespace mango
             : m_promise()
             , m_future(m_promise.get_future())
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                T value = func();
-                m_promise.set_value(value);
-            }, func);
+            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
 
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            pool.enqueue([this, func] () mutable
+            {
+                T value = func();
+                m_promise.set_value(value);
+            });
         }
 
         T get()
@@ -423,7 +966,6 @@ namespace mango
     private:
         using Future = std::future<void>;
         using Promise = std::promise<void>;
-        using Function = std::function<void()>;
 
         Promise m_promise;
         Future m_future;
@@ -434,14 +976,14 @@ namespace mango
             : m_promise()
             , m_future(m_promise.get_future())
         {
-            Function func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
-            auto container = std::bind([this] (Function func) {
-                func();
-                m_promise.set_value();
-            }, func);
+            auto func = std::bind(std::forward<F>(f), std::forward<Args>(args)...);
 
             ThreadPool& pool = ThreadPool::getInstance();
-            pool.enqueue(container);
+            pool.enqueue([this, func] () mutable
+            {
+                func();
+                m_promise.set_value();
+            });
         }
 
         void get()
@@ -455,4 +997,245 @@ namespace mango
         }
     };
 
+    // ----------------------------------------------------------------------------------
+    // parallel_for / parallel_reduce / parallel_for_2d
+    // ----------------------------------------------------------------------------------
+
+    /*
+        Parallel loops over an index range [begin, end) using the ThreadPool. The func is
+        called with half-open sub-ranges: func(first, last). The range is split recursively;
+        each task hands out the upper half of it's range into the pool and keeps the lower
+        half until it is not larger than the grain. Idle workers steal the largest pieces.
+
+        When the grain is not given it is computed from the pool size and the measured
+        cost of a small probe chunk which is executed on the calling thread; cheap loops
+        are executed serially without any scheduling overhead.
+
+        The calls are blocking and cooperative; the calling thread helps the pool until
+        the whole range has been processed.
+
+        Usage example:
+
+        parallel_for(0, height, [&] (size_t y0, size_t y1)
+        {
+            for (size_t y = y0; y < y1; ++y)
+            {
+                // process scanline y
+            }
+        });
+
+        u64 sum = parallel_reduce(0, count, u64(0), [&] (size_t first, size_t last) -> u64
+        {
+            u64 value = 0;
+            for (size_t i = first; i < last; ++i)
+                value += data[i];
+            return value;
+        },
+        [] (u64 a, u64 b)
+        {
+            return a + b;
+        });
+
+    */
+
+    // number of indices per task so that every worker in the pool gets a few tasks
+    size_t parallel_grain(size_t count);
+
+    // grain from the measured cost of probe_count indices taking probe_ns nanoseconds
+    size_t parallel_grain(size_t count, u64 probe_ns, size_t probe_count);
+
+namespace detail
+{
+
+    template <typename F>
+    struct ParallelFor
+    {
+        ThreadPool& pool;
+        F& func;
+        size_t grain;
+
+        // the queue is shared with other loops so each loop counts it's own tasks
+        std::atomic<int> pending { 0 };
+
+        ParallelFor(ThreadPool& pool, F& func, size_t grain)
+            : pool(pool)
+            , func(func)
+            , grain(grain)
+        {
+        }
+
+        void run(size_t first, size_t last)
+        {
+            while (last - first > grain)
+            {
+                size_t middle = first + (last - first) / 2;
+                pending.fetch_add(1, std::memory_order_relaxed);
+                pool.enqueue(&pool.m_parallel_queue, TaskFunction([this, middle, last]
+                {
+                    run(middle, last);
+
+                    // the loop can return as soon as the counter reaches zero
+                    pending.fetch_sub(1, std::memory_order_release);
+                }));
+                last = middle;
+            }
+
+            func(first, last);
+        }
+
+        void wait()
+        {
+            while (pending.load(std::memory_order_acquire) > 0)
+            {
+                pool.dequeue_and_process();
+            }
+        }
+    };
+
+    inline size_t parallel_probe_size(size_t count)
+    {
+        const size_t threads = size_t(ThreadPool::getInstanceSize());
+        return std::max(size_t(1), count / (threads * 16));
+    }
+
+} // namespace detail
+
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, size_t grain, F&& func)
+    {
+        if (begin >= end)
+            return;
+
+        grain = std::max(grain, size_t(1));
+
+        if (end - begin <= grain || ThreadPool::getInstanceSize() <= 1)
+        {
+            func(begin, end);
+            return;
+        }
+
+        detail::ParallelFor<typename std::remove_reference<F>::type> body(ThreadPool::getInstance(), func, grain);
+        body.run(begin, end);
+        body.wait();
+    }
+
+    template <typename F>
+    void parallel_for(size_t begin, size_t end, F&& func)
+    {
+        if (begin >= end)
+            return;
+
+        if (end - begin == 1 || ThreadPool::getInstanceSize() <= 1)
+        {
+            func(begin, end);
+            return;
+        }
+
+        // measure the cost of a small chunk
+        const size_t probe = detail::parallel_probe_size(end - begin);
+
+        Timer timer;
+        func(begin, begin + probe);
+        const u64 elapsed = timer.ns();
+
+        begin += probe;
+        parallel_for(begin, end, parallel_grain(end - begin, elapsed, probe), func);
+    }
+
+    template <typename T, typename F, typename R>
+    T parallel_reduce(size_t begin, size_t end, size_t grain, T identity, F&& func, R&& reduce)
+    {
+        if (begin >= end)
+            return identity;
+
+        grain = std::max(grain, size_t(1));
+
+        // partial results are reduced in order; the reduction only needs to be associative
+        const size_t chunks = (end - begin + grain - 1) / grain;
+        std::vector<T> partial(chunks, identity);
+
+        parallel_for(0, chunks, 1, [&] (size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const size_t x0 = begin + i * grain;
+                const size_t x1 = std::min(x0 + grain, end);
+                partial[i] = func(x0, x1);
+            }
+        });
+
+        T value = identity;
+        for (auto& result : partial)
+        {
+            value = reduce(value, result);
+        }
+
+        return value;
+    }
+
+    template <typename T, typename F, typename R>
+    T parallel_reduce(size_t begin, size_t end, T identity, F&& func, R&& reduce)
+    {
+        if (begin >= end)
+            return identity;
+
+        if (ThreadPool::getInstanceSize() <= 1)
+        {
+            return reduce(identity, func(begin, end));
+        }
+
+        const size_t probe = detail::parallel_probe_size(end - begin);
+
+        Timer timer;
+        T value = reduce(identity, func(begin, begin + probe));
+        const u64 elapsed = timer.ns();
+
+        begin += probe;
+        if (begin >= end)
+            return value;
+
+        const size_t grain = parallel_grain(end - begin, elapsed, probe);
+        return reduce(value, parallel_reduce(begin, end, grain, identity, func, reduce));
+    }
+
+    // func(x0, y0, x1, y1) is called for tiles of the rectangle [0, width) x [0, height)
+
+    template <typename F>
+    void parallel_for_2d(size_t width, size_t height, size_t tile_width, size_t tile_height, F&& func)
+    {
+        if (!width || !height)
+            return;
+
+        tile_width = std::max(std::min(tile_width, width), size_t(1));
+        tile_height = std::max(std::min(tile_height, height), size_t(1));
+
+        const size_t xtiles = (width + tile_width - 1) / tile_width;
+        const size_t ytiles = (height + tile_height - 1) / tile_height;
+
+        parallel_for(0, xtiles * ytiles, [&] (size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                const size_t x0 = (i % xtiles) * tile_width;
+                const size_t y0 = (i / xtiles) * tile_height;
+                func(x0, y0, std::min(x0 + tile_width, width), std::min(y0 + tile_height, height));
+            }
+        });
+    }
+
+    template <typename F>
+    void parallel_for_2d(size_t width, size_t height, F&& func)
+    {
+        if (!width || !height)
+            return;
+
+        // full-width bands keep the scanlines contiguous; split the columns only
+        // when there are not enough rows to keep the pool busy
+        const size_t tasks = size_t(ThreadPool::getInstanceSize()) * 4;
+        const size_t columns = std::min(width, (tasks + height - 1) / height);
+        const size_t tile_width = (width + columns - 1) / columns;
+
+        parallel_for_2d(width, height, tile_width, 1, func);
+    }
+
 } // namespace mango
@@ -19,8 +19,8 @@ namespace filesystem {
     {
     protected:
         std::string m_filename;
-        std::unique_ptr<Path> m_path;
-        std::unique_ptr<VirtualMemory> m_memory;
+        std::shared_ptr<Path> m_path;
+        std::shared_ptr<VirtualMemory> m_memory;
 
         ConstMemory getMemory() const;
 
@@ -36,6 +36,7 @@ namespace filesystem {
 
         // memory
         operator ConstMemory () const;
+        operator MemoryView () const;
         operator const u8* () const;
         const u8* data() const;
         size_t size() const;
@@ -64,5 +65,175 @@ namespace filesystem {
         }
     };
 
+    /*
+        NativeFileStream is a buffered Stream on a native file handle. Small writes are
+        combined in a large buffer; large writes and lists of memory spans are written
+        together with the buffered data in a single vectored system call. The size and
+        offset are tracked by the stream so querying them does not make system calls.
+
+        DIRECT bypasses the operating system file cache when writing (Linux: O_DIRECT).
+        It is intended for sequentially written huge outputs which would otherwise evict
+        the working set from the page cache; seeking ends the direct mode.
+
+        Usage example:
+
+        NativeFileStream file("output.bin", Stream::WRITE);
+
+        ConstMemory spans[] = { header, payload, footer };
+        file.write(spans, 3);
+
+    */
+
+    class NativeFileStream : public Stream
+    {
+    protected:
+        struct NativeFileHandle* m_handle;
+
+    public:
+        enum Flags : u32
+        {
+            NONE   = 0x0,
+            DIRECT = 0x1,
+        };
+
+        NativeFileStream(const std::string& filename, OpenMode mode, u32 flags = NONE, size_t buffer_size = 1024 * 1024);
+        ~NativeFileStream();
+
+        const std::string& filename() const;
+
+        u64 size() const;
+        u64 offset() const;
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+        void write(const ConstMemory* spans, size_t count);
+        void flush();
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+    };
+
+    /*
+        MappedFileStream is an output Stream which writes directly into a shared memory
+        mapping of the file. The file grows geometrically as data is written and is
+        truncated to the written size when the stream is closed.
+
+        Encoders which know an upper bound of their output size can encode directly into
+        the file: acquire() returns writable memory at the current offset and commit()
+        advances the offset by the number of bytes actually written. The memory is valid
+        until the next call which can grow the mapping (write, acquire, seek past the end).
+
+        Usage example:
+
+        MappedFileStream file("output.z");
+
+        Memory dest = file.acquire(zlib::bound(source.size));
+        size_t bytes = zlib::compress(dest, source, 6);
+        file.commit(bytes);
+
+    */
+
+    class MappedFileStream : public Stream
+    {
+    protected:
+        struct MappedFileHandle* m_handle;
+
+    public:
+        MappedFileStream(const std::string& filename, u64 reserve = 0);
+        ~MappedFileStream();
+
+        const std::string& filename() const;
+
+        u64 size() const;
+        u64 offset() const;
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+
+        Memory acquire(size_t bytes);
+        void commit(size_t bytes);
+
+        // written contents of the file
+        Memory memory() const;
+    };
+
+    /*
+        PrefetchStream is a read-ahead input Stream. It keeps a ring of aligned blocks
+        with reads in flight ahead of the consumer so that decoding the current block
+        overlaps with the I/O of the following blocks. The reads are submitted with
+        io_uring on Linux and by a dedicated reader thread on other platforms (or when
+        the kernel does not support io_uring).
+
+        acquire() returns the remaining part of the current block without copying; the
+        memory is valid until the next call to acquire(), read() or seek(). An empty
+        memory is returned at the end of the file.
+
+        Usage example:
+
+        PrefetchStream stream("huge.bin");
+
+        for (ConstMemory block = stream.acquire(); block.size; block = stream.acquire())
+        {
+            decode(block);
+        }
+
+    */
+
+    class PrefetchStream : public Stream
+    {
+    protected:
+        struct PrefetchHandle* m_handle;
+
+    public:
+        enum Backend : u32
+        {
+            DEFAULT = 0, // io_uring if available, otherwise THREAD
+            THREAD  = 1,
+        };
+
+        PrefetchStream(const std::string& filename, size_t block_size = 1024 * 1024, u32 depth = 4, Backend backend = DEFAULT);
+        ~PrefetchStream();
+
+        const std::string& filename() const;
+
+        u64 size() const;
+        u64 offset() const;
+        void seek(u64 distance, SeekMode mode);
+        void read(void* dest, size_t size);
+        void write(const void* data, size_t size);
+
+        void write(ConstMemory memory)
+        {
+            Stream::write(memory);
+        }
+
+        ConstMemory acquire();
+    };
+
+#ifdef MANGO_ENABLE_COROUTINES
+
+    // map the file in a ThreadPool worker
+    inline AsyncTask<std::unique_ptr<File>> async_open(std::string filename, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        co_await schedule(pool);
+        co_return std::make_unique<File>(filename);
+    }
+
+    // the path is shared with the task so that it stays alive until the file is mapped
+    inline AsyncTask<std::unique_ptr<File>> async_open(std::shared_ptr<Path> path, std::string filename, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        co_await schedule(pool);
+        co_return std::make_unique<File>(*path, filename);
+    }
+
+#endif
+
 } // namespace filesystem
 } // namespace mango
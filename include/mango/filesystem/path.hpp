@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include "../core/configure.hpp"
+#include "../core/string.hpp"
 #include "mapper.hpp"
 
 namespace mango {
@@ -58,10 +59,16 @@ namespace filesystem {
     };
 
     // filename manipulation functions (example: "foo/bar/readme.txt")
-    std::string getPath(const std::string& filename);           // "foo/bar/"
-    std::string removePath(const std::string& filename);        // "readme.txt"
-    std::string getExtension(const std::string& filename);      // ".txt"
-    std::string removeExtension(const std::string& filename);   // "foo/bar/readme"
+    std::string getPath(StringView filename);           // "foo/bar/"
+    std::string removePath(StringView filename);        // "readme.txt"
+    std::string getExtension(StringView filename);      // ".txt"
+    std::string removeExtension(StringView filename);   // "foo/bar/readme"
+
+    // non-allocating versions; the result refers to the filename storage
+    StringView getPathView(StringView filename);
+    StringView removePathView(StringView filename);
+    StringView getExtensionView(StringView filename);
+    StringView removeExtensionView(StringView filename);
 
 } // namespace filesystem
 } // namespace mango
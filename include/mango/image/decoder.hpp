@@ -89,4 +89,23 @@ namespace mango
     void registerImageDecoder(ImageDecoder::CreateDecoderFunc func, const std::string& extension);
     bool isImageDecoder(const std::string& extension);
 
+#ifdef MANGO_ENABLE_COROUTINES
+
+    // The decoder and the destination surface must outlive the returned tasks.
+
+    inline AsyncTask<ImageHeader> async_header(ImageDecoder& decoder, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        co_await schedule(pool);
+        co_return decoder.header();
+    }
+
+    inline AsyncTask<ImageDecodeStatus> async_decode(ImageDecoder& decoder, Surface& dest, ImageDecodeOptions options = ImageDecodeOptions(),
+                                                     int level = 0, int depth = 0, int face = 0, ThreadPool& pool = ThreadPool::getInstance())
+    {
+        co_await schedule(pool);
+        co_return decoder.decode(dest, options, level, depth, face);
+    }
+
+#endif
+
 } // namespace mango
@@ -59,6 +59,7 @@ namespace mango
     {
     public:
         Bitmap(int width, int height, const Format& format, int stride = 0);
+        Bitmap(int width, int height, const Format& format, int stride, Alignment alignment);
         Bitmap(const Surface& source, const Format& format);
         Bitmap(ConstMemory memory, const std::string& extension);
         Bitmap(ConstMemory memory, const std::string& extension, const Format& format);
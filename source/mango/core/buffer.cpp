@@ -5,6 +5,11 @@
 #include <mango/core/buffer.hpp>
 #include <mango/core/exception.hpp>
 
+#if defined(MANGO_PLATFORM_LINUX)
+    #include <sys/mman.h>
+    #define MANGO_BUFFER_REMAP
+#endif
+
 namespace mango {
 
     // ----------------------------------------------------------------------------
@@ -12,47 +17,77 @@ namespace mango {
     // ----------------------------------------------------------------------------
 
     Buffer::Buffer(Alignment alignment)
-        : m_memory()
+        : m_arena(nullptr)
+        , m_memory()
         , m_capacity(0)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
     }
 
     Buffer::Buffer(size_t bytes, Alignment alignment)
-        : m_memory(allocate(bytes, alignment), bytes)
+        : m_arena(nullptr)
+        , m_memory(allocate(bytes, alignment), bytes)
+        , m_capacity(bytes)
+        , m_alignment(alignment)
+        , m_mapped(false)
+    {
+    }
+
+    Buffer::Buffer(Arena& arena, Alignment alignment)
+        : m_arena(&arena)
+        , m_memory()
+        , m_capacity(0)
+        , m_alignment(alignment)
+        , m_mapped(false)
+    {
+    }
+
+    Buffer::Buffer(size_t bytes, Arena& arena, Alignment alignment)
+        : m_arena(&arena)
+        , m_memory(allocate(bytes, alignment), bytes)
         , m_capacity(bytes)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
     }
 
     Buffer::Buffer(size_t bytes, u8 value, Alignment alignment)
-        : m_memory(allocate(bytes, alignment), bytes)
+        : m_arena(nullptr)
+        , m_memory(allocate(bytes, alignment), bytes)
         , m_capacity(bytes)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
         std::memset(m_memory.address, value, bytes);
     }
 
     Buffer::Buffer(const u8* source, size_t bytes, Alignment alignment)
-        : m_memory(allocate(bytes, alignment), bytes)
+        : m_arena(nullptr)
+        , m_memory(allocate(bytes, alignment), bytes)
         , m_capacity(bytes)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
         std::memcpy(m_memory.address, source, bytes);
     }
 
     Buffer::Buffer(ConstMemory memory, Alignment alignment)
-        : m_memory(allocate(memory.size, alignment), memory.size)
+        : m_arena(nullptr)
+        , m_memory(allocate(memory.size, alignment), memory.size)
         , m_capacity(memory.size)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
         std::memcpy(m_memory.address, memory.address, memory.size);
     }
 
     Buffer::Buffer(Stream& stream, Alignment alignment)
-        : m_memory(allocate(stream.size(), alignment), stream.size())
+        : m_arena(nullptr)
+        , m_memory(allocate(stream.size(), alignment), stream.size())
         , m_capacity(m_memory.size)
         , m_alignment(alignment)
+        , m_mapped(false)
     {
         stream.seek(0, Stream::BEGIN);
         stream.read(m_memory.address, m_memory.size);
@@ -98,6 +133,7 @@ namespace mango {
         free(m_memory.address);
         m_memory = Memory();
         m_capacity = 0;
+        m_mapped = false;
     }
 
     void Buffer::resize(size_t bytes)
@@ -110,6 +146,9 @@ namespace mango {
     {
         if (bytes > m_capacity)
         {
+            if (remap(bytes))
+                return;
+
             u8* storage = allocate(bytes, m_alignment);
             if (m_memory.address)
             {
@@ -136,13 +175,217 @@ namespace mango {
 
     u8* Buffer::allocate(size_t bytes, Alignment alignment) const
     {
-        void* ptr = aligned_malloc(bytes, alignment);
+        void* ptr = m_arena ? m_arena->allocate(bytes, alignment) : aligned_malloc(bytes, alignment);
         return reinterpret_cast<u8*>(ptr);
     }
 
     void Buffer::free(u8* ptr) const
     {
-        aligned_free(ptr);
+#ifdef MANGO_BUFFER_REMAP
+        if (m_mapped)
+        {
+            ::munmap(ptr, m_capacity);
+            return;
+        }
+#endif
+
+        // arena memory is released when the arena is rewound
+        if (!m_arena)
+        {
+            aligned_free(ptr);
+        }
+    }
+
+#ifdef MANGO_BUFFER_REMAP
+
+    // heap buffers larger than this are moved into a private memory mapping
+    static const size_t remap_threshold = 1024 * 1024;
+    static const size_t remap_page_size = 4096;
+
+    bool Buffer::remap(size_t bytes)
+    {
+        if (!m_mapped)
+        {
+            const bool eligible = !m_arena && !m_alignment.policy() && u32(m_alignment) <= remap_page_size;
+            if (!eligible || bytes < remap_threshold)
+                return false;
+        }
+
+        const size_t capacity = (bytes + remap_page_size - 1) & ~(remap_page_size - 1);
+
+        void* address;
+        if (m_mapped)
+        {
+            // the kernel moves the page table entries; the contents are not copied
+            address = ::mremap(m_memory.address, m_capacity, capacity, MREMAP_MAYMOVE);
+            if (address == MAP_FAILED)
+            {
+                MANGO_EXCEPTION("[Buffer] Out of memory.");
+            }
+        }
+        else
+        {
+            // this is the last time the contents are copied
+            address = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED)
+                return false;
+
+            if (m_memory.address)
+            {
+                std::memcpy(address, m_memory.address, m_memory.size);
+                aligned_free(m_memory.address);
+            }
+
+            m_mapped = true;
+        }
+
+        m_memory.address = reinterpret_cast<u8*>(address);
+        m_capacity = capacity;
+        return true;
+    }
+
+#else
+
+    bool Buffer::remap(size_t bytes)
+    {
+        MANGO_UNREFERENCED(bytes);
+        return false;
+    }
+
+#endif
+
+    // ----------------------------------------------------------------------------
+    // MemoryView
+    // ----------------------------------------------------------------------------
+
+    MemoryView::MemoryView(Buffer&& buffer)
+    {
+        std::shared_ptr<Buffer> owner;
+
+        if (buffer.m_arena)
+        {
+            // the arena memory is released with the arena scope; the view needs a copy
+            owner = std::make_shared<Buffer>(ConstMemory(buffer.m_memory), buffer.m_alignment);
+            buffer.reset();
+        }
+        else
+        {
+            // steal the allocation
+            owner = std::make_shared<Buffer>(buffer.m_alignment);
+            std::swap(owner->m_memory, buffer.m_memory);
+            std::swap(owner->m_capacity, buffer.m_capacity);
+            std::swap(owner->m_mapped, buffer.m_mapped);
+        }
+
+        m_memory = owner->m_memory;
+        m_owner = std::move(owner);
+    }
+
+    // ----------------------------------------------------------------------------
+    // RopeBuffer
+    // ----------------------------------------------------------------------------
+
+    RopeBuffer::RopeBuffer(size_t chunk_size)
+        : m_size(0)
+        , m_chunk_size(std::max(chunk_size, size_t(256)))
+    {
+    }
+
+    RopeBuffer::~RopeBuffer()
+    {
+        reset();
+    }
+
+    size_t RopeBuffer::size() const
+    {
+        return m_size;
+    }
+
+    size_t RopeBuffer::count() const
+    {
+        return m_chunks.size();
+    }
+
+    ConstMemory RopeBuffer::operator [] (size_t index) const
+    {
+        return ConstMemory(m_chunks[index].address, m_chunks[index].size);
+    }
+
+    void RopeBuffer::reset()
+    {
+        for (auto& chunk : m_chunks)
+        {
+            aligned_free(chunk.address);
+        }
+
+        m_chunks.clear();
+        m_size = 0;
+    }
+
+    void RopeBuffer::append(const void* source, size_t bytes)
+    {
+        const u8* src = reinterpret_cast<const u8*>(source);
+
+        // fill the last chunk before starting a new one
+        if (!m_chunks.empty())
+        {
+            Chunk& chunk = m_chunks.back();
+            size_t n = std::min(bytes, chunk.capacity - chunk.size);
+            std::memcpy(chunk.address + chunk.size, src, n);
+            chunk.size += n;
+            m_size += n;
+            src += n;
+            bytes -= n;
+        }
+
+        if (bytes > 0)
+        {
+            std::memcpy(append(bytes), src, bytes);
+        }
+    }
+
+    u8* RopeBuffer::append(size_t bytes)
+    {
+        if (m_chunks.empty() || m_chunks.back().capacity - m_chunks.back().size < bytes)
+        {
+            // double the chunk size up to 16 MB
+            size_t capacity = m_chunk_size;
+            if (!m_chunks.empty())
+            {
+                capacity = std::max(capacity, std::min(m_chunks.back().capacity * 2, size_t(16) << 20));
+            }
+
+            capacity = std::max(capacity, bytes);
+
+            Chunk chunk;
+            chunk.address = reinterpret_cast<u8*>(aligned_malloc(capacity));
+            chunk.size = 0;
+            chunk.capacity = capacity;
+            m_chunks.push_back(chunk);
+        }
+
+        Chunk& chunk = m_chunks.back();
+        u8* address = chunk.address + chunk.size;
+        chunk.size += bytes;
+        m_size += bytes;
+        return address;
+    }
+
+    void RopeBuffer::copy(u8* dest) const
+    {
+        for (auto& chunk : m_chunks)
+        {
+            std::memcpy(dest, chunk.address, chunk.size);
+            dest += chunk.size;
+        }
+    }
+
+    void RopeBuffer::write(Stream& stream) const
+    {
+        for (auto& chunk : m_chunks)
+        {
+            stream.write(chunk.address, chunk.size);
+        }
     }
 
     // ----------------------------------------------------------------------------
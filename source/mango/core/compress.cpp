@@ -4,6 +4,8 @@
 */
 
 #include <vector>
+#include <atomic>
+#include <memory>
 
 #include <mango/core/compress.hpp>
 #include <mango/core/exception.hpp>
@@ -11,9 +13,12 @@
 #include <mango/core/bits.hpp>
 #include <mango/core/endian.hpp>
 #include <mango/core/pointer.hpp>
+#include <mango/core/thread.hpp>
 #include <mango/math/math.hpp>
 
 #ifdef MANGO_ENABLE_LICENSE_BSD
+#define LZ4_STATIC_LINKING_ONLY
+#define LZ4_HC_STATIC_LINKING_ONLY
 #include "../../external/lz4/lz4.h"
 #include "../../external/lz4/lz4hc.h"
 #include "../../external/lzo/minilzo.h"
@@ -115,6 +120,173 @@ namespace lz4 {
         return dest.size;
     }
 
+    // dictionary
+
+    namespace
+    {
+
+        // The dictionary is loaded into a stream once and the loaded stream is attached
+        // to the working stream for each compression. The loaded streams reference the
+        // dictionary memory and are identified by the dictionary id; the HC stream also
+        // depends on the compression level. The cache is per thread so the streams are
+        // never shared.
+        struct DictionaryCacheLZ4
+        {
+            LZ4_stream_t* dictionary = nullptr;
+            LZ4_stream_t* stream = nullptr;
+            LZ4_streamHC_t* dictionary_hc = nullptr;
+            LZ4_streamHC_t* stream_hc = nullptr;
+            u64 id = 0;
+            u64 id_hc = 0;
+            int level_hc = 0;
+
+            ~DictionaryCacheLZ4()
+            {
+                LZ4_freeStream(dictionary);
+                LZ4_freeStream(stream);
+                LZ4_freeStreamHC(dictionary_hc);
+                LZ4_freeStreamHC(stream_hc);
+            }
+        };
+
+        thread_local DictionaryCacheLZ4 g_dictionary_cache;
+
+        // lz4 can only reference the last 64 KB of the dictionary
+        ConstMemory dictionary_window(ConstMemory dictionary)
+        {
+            const size_t size = std::min(dictionary.size, size_t(1024 * 64));
+            return ConstMemory(dictionary.address + dictionary.size - size, size);
+        }
+
+    } // namespace
+
+    size_t compress(Memory dest, ConstMemory source, const Dictionary& dictionary, int level)
+    {
+        const int source_size = int(source.size);
+        const int dest_size = int(dest.size);
+
+        DictionaryCacheLZ4& cache = g_dictionary_cache;
+        ConstMemory window = dictionary_window(dictionary.memory());
+
+        int written = 0;
+
+        level = clamp(level, 0, 10);
+
+        if (level > 6)
+        {
+            const int compression_level = 1 + (level - 7) * 5;
+            const bool loaded = cache.dictionary_hc && cache.id_hc == dictionary.id() && cache.level_hc == compression_level;
+
+            if (!cache.dictionary_hc)
+            {
+                cache.dictionary_hc = LZ4_createStreamHC();
+                cache.stream_hc = LZ4_createStreamHC();
+            }
+
+            if (!loaded)
+            {
+                LZ4_resetStreamHC_fast(cache.dictionary_hc, compression_level);
+                LZ4_loadDictHC(cache.dictionary_hc, window.cast<const char>(), int(window.size));
+                cache.id_hc = dictionary.id();
+                cache.level_hc = compression_level;
+            }
+
+            LZ4_resetStreamHC_fast(cache.stream_hc, compression_level);
+            LZ4_attach_HC_dictionary(cache.stream_hc, cache.dictionary_hc);
+            written = LZ4_compress_HC_continue(cache.stream_hc, source.cast<const char>(), dest.cast<char>(), source_size, dest_size);
+        }
+        else
+        {
+            const bool loaded = cache.dictionary && cache.id == dictionary.id();
+
+            if (!cache.dictionary)
+            {
+                cache.dictionary = LZ4_createStream();
+                cache.stream = LZ4_createStream();
+            }
+
+            if (!loaded)
+            {
+                LZ4_loadDict(cache.dictionary, window.cast<const char>(), int(window.size));
+                cache.id = dictionary.id();
+            }
+
+            const int acceleration = 19 - level * 3;
+            LZ4_resetStream_fast(cache.stream);
+            LZ4_attach_dictionary(cache.stream, cache.dictionary);
+            written = LZ4_compress_fast_continue(cache.stream, source.cast<const char>(), dest.cast<char>(), source_size, dest_size, acceleration);
+        }
+
+        if (written <= 0 || size_t(written) > dest.size)
+        {
+            MANGO_EXCEPTION("[lz4] compression failed.");
+        }
+
+        return size_t(written);
+    }
+
+    size_t decompress(Memory dest, ConstMemory source, const Dictionary& dictionary)
+    {
+        ConstMemory window = dictionary_window(dictionary.memory());
+
+        int status = LZ4_decompress_safe_usingDict(source.cast<const char>(), dest.cast<char>(),
+            int(source.size), int(dest.size), window.cast<const char>(), int(window.size));
+        if (status < 0)
+        {
+            MANGO_EXCEPTION("[lz4] decompression failed.");
+        }
+
+        return dest.size;
+    }
+
+    // context
+
+    class CompressContextLZ4 : public CompressContext
+    {
+    protected:
+        Buffer m_state;
+        Buffer m_state_hc;
+
+    public:
+        CompressContextLZ4()
+            : m_state(LZ4_sizeofState())
+        {
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            const int source_size = int(source.size);
+            const int dest_size = int(dest.size);
+
+            int written = 0;
+
+            level = clamp(level, 0, 10);
+
+            if (level > 6)
+            {
+                if (!m_state_hc.size())
+                {
+                    m_state_hc.resize(LZ4_sizeofStateHC());
+                }
+
+                const int compression_level = 1 + (level - 7) * 5;
+                written = LZ4_compress_HC_extStateHC(m_state_hc, source.cast<const char>(), dest.cast<char>(), source_size, dest_size, compression_level);
+            }
+            else
+            {
+                const int acceleration = 19 - level * 3;
+                written = LZ4_compress_fast_extState(m_state, source.cast<const char>(), dest.cast<char>(), source_size, dest_size, acceleration);
+            }
+
+            if (written <= 0 || size_t(written) > dest.size)
+            {
+                MANGO_EXCEPTION("[lz4] compression failed.");
+            }
+
+            return size_t(written);
+        }
+    };
+
     // stream
 
     class StreamEncoderLZ4 : public StreamEncoder
@@ -127,10 +299,15 @@ namespace lz4 {
         size_t m_offset { 0 };
 
     public:
-        StreamEncoderLZ4(int level)
+        StreamEncoderLZ4(int level, ConstMemory dictionary)
             : m_acceleration(level)
         {
             m_stream = LZ4_createStream();
+
+            if (dictionary.size)
+            {
+                LZ4_loadDict(m_stream, dictionary.cast<const char>(), int(dictionary.size));
+            }
         }
 
         ~StreamEncoderLZ4()
@@ -186,9 +363,14 @@ namespace lz4 {
         size_t m_offset { 0 };
 
     public:
-        StreamDecoderLZ4()
+        StreamDecoderLZ4(ConstMemory dictionary)
         {
             m_stream = LZ4_createStreamDecode();
+
+            if (dictionary.size)
+            {
+                LZ4_setStreamDecode(m_stream, dictionary.cast<const char>(), int(dictionary.size));
+            }
         }
 
         ~StreamDecoderLZ4()
@@ -229,15 +411,15 @@ namespace lz4 {
         }
     };
 
-    SharedObject<StreamEncoder> createStreamEncoder(int level)
+    SharedObject<StreamEncoder> createStreamEncoder(int level, ConstMemory dictionary)
     {
-        StreamEncoder* encoder = new StreamEncoderLZ4(level);
+        StreamEncoder* encoder = new StreamEncoderLZ4(level, dictionary);
         return encoder;
     }
 
-    SharedObject<StreamDecoder> createStreamDecoder()
+    SharedObject<StreamDecoder> createStreamDecoder(ConstMemory dictionary)
     {
-        StreamDecoder* decoder = new StreamDecoderLZ4();
+        StreamDecoder* decoder = new StreamDecoderLZ4(dictionary);
         return decoder;
     }
 
@@ -284,6 +466,36 @@ namespace lzo {
         return dest.size;
     }
 
+
+    // context
+
+    class CompressContextLZO : public CompressContext
+    {
+    protected:
+        Buffer m_workmem;
+
+    public:
+        CompressContextLZO()
+            : m_workmem(LZO1X_MEM_COMPRESS)
+        {
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            MANGO_UNREFERENCED(level);
+
+            lzo_uint dst_len = (lzo_uint)dest.size;
+            int x = lzo1x_1_compress(source.address, lzo_uint(source.size),
+                dest.address, &dst_len, m_workmem);
+            if (x != LZO_E_OK)
+            {
+                MANGO_EXCEPTION("[lzo] compression failed.");
+            }
+
+            return size_t(dst_len);
+        }
+    };
+
 } // namespace lzo
 
 // ----------------------------------------------------------------------------
@@ -329,6 +541,163 @@ namespace zstd {
         return dest.size;
     }
 
+    // dictionary
+
+    namespace
+    {
+
+        // The digested dictionaries are cached per thread. They are identified by the
+        // dictionary id; the CDict also has the compression level baked in.
+        struct DictionaryCacheZSTD
+        {
+            ZSTD_CCtx* cctx = nullptr;
+            ZSTD_DCtx* dctx = nullptr;
+            ZSTD_CDict* cdict = nullptr;
+            ZSTD_DDict* ddict = nullptr;
+            u64 cid = 0;
+            u64 did = 0;
+            int level = 0;
+
+            ~DictionaryCacheZSTD()
+            {
+                ZSTD_freeCDict(cdict);
+                ZSTD_freeDDict(ddict);
+                ZSTD_freeCCtx(cctx);
+                ZSTD_freeDCtx(dctx);
+            }
+        };
+
+        thread_local DictionaryCacheZSTD g_dictionary_cache;
+
+    } // namespace
+
+    size_t compress(Memory dest, ConstMemory source, const Dictionary& dictionary, int level)
+    {
+        // zstd compress does not support encoding of empty source
+        if (!source.size)
+            return 0;
+
+        level = clamp(level * 2, 1, 20);
+
+        DictionaryCacheZSTD& cache = g_dictionary_cache;
+
+        if (!cache.cctx)
+        {
+            cache.cctx = ZSTD_createCCtx();
+        }
+
+        if (!cache.cdict || cache.cid != dictionary.id() || cache.level != level)
+        {
+            ConstMemory memory = dictionary.memory();
+            ZSTD_freeCDict(cache.cdict);
+            cache.cdict = ZSTD_createCDict(memory.address, memory.size, level);
+            cache.cid = dictionary.id();
+            cache.level = level;
+        }
+
+        const size_t x = ZSTD_compress_usingCDict(cache.cctx, dest.address, dest.size,
+                                                  source.address, source.size, cache.cdict);
+        if (ZSTD_isError(x))
+        {
+            MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+        }
+
+        return x;
+    }
+
+    size_t decompress(Memory dest, ConstMemory source, const Dictionary& dictionary)
+    {
+        DictionaryCacheZSTD& cache = g_dictionary_cache;
+
+        if (!cache.dctx)
+        {
+            cache.dctx = ZSTD_createDCtx();
+        }
+
+        if (!cache.ddict || cache.did != dictionary.id())
+        {
+            ConstMemory memory = dictionary.memory();
+            ZSTD_freeDDict(cache.ddict);
+            cache.ddict = ZSTD_createDDict(memory.address, memory.size);
+            cache.did = dictionary.id();
+        }
+
+        size_t x = ZSTD_decompress_usingDDict(cache.dctx, dest.address, dest.size,
+                                              source.address, source.size, cache.ddict);
+        if (ZSTD_isError(x))
+        {
+            MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+        }
+
+        return dest.size;
+    }
+
+    // context
+
+    class CompressContextZSTD : public CompressContext
+    {
+    protected:
+        ZSTD_CCtx* m_context;
+
+    public:
+        CompressContextZSTD()
+        {
+            m_context = ZSTD_createCCtx();
+        }
+
+        ~CompressContextZSTD()
+        {
+            ZSTD_freeCCtx(m_context);
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            // zstd compress does not support encoding of empty source
+            if (!source.size)
+                return 0;
+
+            level = clamp(level * 2, 1, 20);
+
+            const size_t x = ZSTD_compressCCtx(m_context, dest.address, dest.size,
+                                               source.address, source.size, level);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return x;
+        }
+    };
+
+    class DecompressContextZSTD : public DecompressContext
+    {
+    protected:
+        ZSTD_DCtx* m_context;
+
+    public:
+        DecompressContextZSTD()
+        {
+            m_context = ZSTD_createDCtx();
+        }
+
+        ~DecompressContextZSTD()
+        {
+            ZSTD_freeDCtx(m_context);
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            size_t x = ZSTD_decompressDCtx(m_context, dest.address, dest.size,
+                                           source.address, source.size);
+            if (ZSTD_isError(x))
+            {
+                MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(x));
+            }
+
+            return dest.size;
+        }
+    };
+
     // stream
 
     class StreamEncoderZSTD : public StreamEncoder
@@ -337,11 +706,16 @@ namespace zstd {
         ZSTD_CStream* z;
 
     public:
-        StreamEncoderZSTD(int level)
+        StreamEncoderZSTD(int level, ConstMemory dictionary)
         {
             level = clamp(level * 2, 1, 20);
             z = ZSTD_createCStream();
             ZSTD_initCStream(z, level);
+
+            if (dictionary.size)
+            {
+                ZSTD_CCtx_loadDictionary(z, dictionary.address, dictionary.size);
+            }
         }
 
         ~StreamEncoderZSTD()
@@ -387,10 +761,15 @@ namespace zstd {
         ZSTD_DStream* z;
 
     public:
-        StreamDecoderZSTD()
+        StreamDecoderZSTD(ConstMemory dictionary)
         {
             z = ZSTD_createDStream();
             ZSTD_initDStream(z);
+
+            if (dictionary.size)
+            {
+                ZSTD_DCtx_loadDictionary(z, dictionary.address, dictionary.size);
+            }
         }
 
         ~StreamDecoderZSTD()
@@ -421,15 +800,15 @@ namespace zstd {
         }
     };
 
-    SharedObject<StreamEncoder> createStreamEncoder(int level)
+    SharedObject<StreamEncoder> createStreamEncoder(int level, ConstMemory dictionary)
     {
-        StreamEncoder* encoder = new StreamEncoderZSTD(level);
+        StreamEncoder* encoder = new StreamEncoderZSTD(level, dictionary);
         return encoder;
     }
 
-    SharedObject<StreamDecoder> createStreamDecoder()
+    SharedObject<StreamDecoder> createStreamDecoder(ConstMemory dictionary)
     {
-        StreamDecoder* decoder = new StreamDecoderZSTD();
+        StreamDecoder* decoder = new StreamDecoderZSTD(dictionary);
         return decoder;
     }
 
@@ -561,6 +940,44 @@ namespace lzfse {
         return written;
     }
 
+
+    // context
+
+    class CompressContextLZFSE : public CompressContext
+    {
+    protected:
+        Buffer m_scratch;
+
+    public:
+        CompressContextLZFSE()
+            : m_scratch(lzfse_encode_scratch_size())
+        {
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            MANGO_UNREFERENCED(level);
+            return lzfse_encode_buffer(dest.address, dest.size, source, source.size, m_scratch);
+        }
+    };
+
+    class DecompressContextLZFSE : public DecompressContext
+    {
+    protected:
+        Buffer m_scratch;
+
+    public:
+        DecompressContextLZFSE()
+            : m_scratch(lzfse_decode_scratch_size())
+        {
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            return lzfse_decode_buffer(dest.address, dest.size, source, source.size, m_scratch);
+        }
+    };
+
 } // namespace lzfse
 
 #endif // MANGO_ENABLE_LICENSE_ZLIB
@@ -660,6 +1077,120 @@ namespace lzma
         return dest.size;
     }
 
+    // context
+
+    class CompressContextLZMA : public CompressContext
+    {
+    protected:
+        CLzmaEncHandle m_encoder;
+
+    public:
+        CompressContextLZMA()
+        {
+            m_encoder = LzmaEnc_Create(&g_Alloc);
+        }
+
+        ~CompressContextLZMA()
+        {
+            LzmaEnc_Destroy(m_encoder, &g_Alloc, &g_Alloc);
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            CLzmaEncProps props;
+            LzmaEncProps_Init(&props);
+
+            level = clamp(level - 1, 0, 9);
+
+            props.level = level;
+            props.dictSize = 2048 << level;
+            props.lc = 3;
+            props.lp = 0;
+            props.pb = 2;
+            props.fb = 32;
+            props.numThreads = 1;
+
+            // the match finder and range coder buffers are kept in the encoder
+            // and re-used as long as the dictionary size does not change
+            SizeT props_output_size = LZMA_PROPS_SIZE;
+            SizeT dest_length = dest.size - LZMA_PROPS_SIZE;
+
+            SRes result = LzmaEnc_SetProps(m_encoder, &props);
+            if (result == SZ_OK)
+            {
+                result = LzmaEnc_WriteProperties(m_encoder, dest.address, &props_output_size);
+            }
+
+            if (result == SZ_OK)
+            {
+                result = LzmaEnc_MemEncode(m_encoder, dest.address + LZMA_PROPS_SIZE, &dest_length,
+                    source.address, source.size, 0, nullptr, &g_Alloc, &g_Alloc);
+            }
+
+            const char* error = get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[lzma] %s", error);
+            }
+
+            return LZMA_PROPS_SIZE + dest_length;
+        }
+    };
+
+    class DecompressContextLZMA : public DecompressContext
+    {
+    protected:
+        CLzmaDec m_decoder;
+
+    public:
+        DecompressContextLZMA()
+        {
+            LzmaDec_Construct(&m_decoder);
+        }
+
+        ~DecompressContextLZMA()
+        {
+            LzmaDec_FreeProbs(&m_decoder, &g_Alloc);
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            if (source.size < LZMA_PROPS_SIZE)
+            {
+                MANGO_EXCEPTION("[lzma] %s", get_error_string(SZ_ERROR_INPUT_EOF));
+            }
+
+            // the probability model is re-allocated only when the props change
+            SRes result = LzmaDec_AllocateProbs(&m_decoder, source.address, LZMA_PROPS_SIZE, &g_Alloc);
+            if (result == SZ_OK)
+            {
+                m_decoder.dic = dest.address;
+                m_decoder.dicBufSize = dest.size;
+                LzmaDec_Init(&m_decoder);
+
+                SizeT srcLen = source.size - LZMA_PROPS_SIZE;
+                ELzmaStatus status;
+                result = LzmaDec_DecodeToDic(&m_decoder, dest.size, source.address + LZMA_PROPS_SIZE,
+                    &srcLen, LZMA_FINISH_ANY, &status);
+                if (result == SZ_OK && status == LZMA_STATUS_NEEDS_MORE_INPUT)
+                {
+                    result = SZ_ERROR_INPUT_EOF;
+                }
+            }
+
+            // the destination is not owned by the decoder
+            m_decoder.dic = nullptr;
+
+            const char* error = get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[lzma] %s", error);
+            }
+
+            return dest.size;
+        }
+    };
+
 } // namespace lzma
 
 // ----------------------------------------------------------------------------
@@ -945,6 +1476,117 @@ namespace deflate {
         return bytes_out;
     }
 
+
+    // context
+
+    enum class Format
+    {
+        DEFLATE,
+        ZLIB,
+        GZIP
+    };
+
+    class CompressContextDeflate : public CompressContext
+    {
+    protected:
+        Format m_format;
+        libdeflate_compressor* m_compressors[13] = { nullptr };
+
+    public:
+        CompressContextDeflate(Format format)
+            : m_format(format)
+        {
+        }
+
+        ~CompressContextDeflate()
+        {
+            for (auto compressor : m_compressors)
+            {
+                libdeflate_free_compressor(compressor);
+            }
+        }
+
+        size_t compress(Memory dest, ConstMemory source, int level) override
+        {
+            level = clamp(level, 1, 10);
+            if (level >= 8) level = (level * 12) / 10;
+
+            // libdeflate compressor is configured for one level
+            libdeflate_compressor*& compressor = m_compressors[level];
+            if (!compressor)
+            {
+                compressor = libdeflate_alloc_compressor(level);
+            }
+
+            size_t bytes_out = 0;
+
+            switch (m_format)
+            {
+                case Format::DEFLATE:
+                    bytes_out = libdeflate_deflate_compress(compressor, source, source.size, dest, dest.size);
+                    break;
+                case Format::ZLIB:
+                    bytes_out = libdeflate_zlib_compress(compressor, source, source.size, dest, dest.size);
+                    break;
+                case Format::GZIP:
+                    bytes_out = libdeflate_gzip_compress(compressor, source, source.size, dest, dest.size);
+                    break;
+            }
+
+            return bytes_out;
+        }
+    };
+
+    class DecompressContextDeflate : public DecompressContext
+    {
+    protected:
+        Format m_format;
+        libdeflate_decompressor* m_decompressor;
+
+    public:
+        DecompressContextDeflate(Format format)
+            : m_format(format)
+        {
+            m_decompressor = libdeflate_alloc_decompressor();
+        }
+
+        ~DecompressContextDeflate()
+        {
+            libdeflate_free_decompressor(m_decompressor);
+        }
+
+        size_t decompress(Memory dest, ConstMemory source) override
+        {
+            size_t bytes_out = 0;
+            libdeflate_result result = LIBDEFLATE_SUCCESS;
+            const char* name = "";
+
+            switch (m_format)
+            {
+                case Format::DEFLATE:
+                    result = libdeflate_deflate_decompress(m_decompressor, source, source.size, dest, dest.size, &bytes_out);
+                    name = "deflate";
+                    break;
+                case Format::ZLIB:
+                    result = libdeflate_zlib_decompress(m_decompressor, source, source.size, dest, dest.size, &bytes_out);
+                    name = "zlib";
+                    break;
+                case Format::GZIP:
+                    result = libdeflate_gzip_decompress(m_decompressor, source, source.size, dest, dest.size, &bytes_out);
+                    name = "gzip";
+                    break;
+            }
+
+            const char* error = get_error_string(result);
+            if (error)
+            {
+                MANGO_EXCEPTION("[%s] %s.", name, error);
+            }
+
+            return bytes_out;
+        }
+    };
+
 } // namespace deflate
 
 // ----------------------------------------------------------------------------
@@ -1033,18 +1675,18 @@ namespace gzip {
 
     const std::vector<Compressor> g_compressors =
     {
-        { Compressor::NONE,  "none",  nocompress::bound, nocompress::compress, nocompress::decompress },
-        { Compressor::BZIP2, "bzip2", bzip2::bound, bzip2::compress, bzip2::decompress },
-        { Compressor::LZ4,   "lz4",   lz4::bound,   lz4::compress,   lz4::decompress },
-        { Compressor::LZO,   "lzo",   lzo::bound,   lzo::compress,   lzo::decompress },
-        { Compressor::ZSTD,  "zstd",  zstd::bound,  zstd::compress,  zstd::decompress },
-        { Compressor::LZFSE, "lzfse", lzfse::bound, lzfse::compress, lzfse::decompress },
-        { Compressor::LZMA,  "lzma",  lzma::bound,  lzma::compress,  lzma::decompress },
-        { Compressor::LZMA2, "lzma2", lzma2::bound, lzma2::compress, lzma2::decompress },
-        { Compressor::PPMD8, "ppmd8", ppmd8::bound, ppmd8::compress, ppmd8::decompress },
-        { Compressor::DEFLATE, "deflate", deflate::bound, deflate::compress, deflate::decompress },
-        { Compressor::ZLIB, "zlib", zlib::bound, zlib::compress, zlib::decompress },
-        { Compressor::GZIP, "gzip", gzip::bound, gzip::compress, gzip::decompress },
+        { Compressor::NONE,  "none",  nocompress::bound, nocompress::compress, nocompress::decompress, nullptr, nullptr },
+        { Compressor::BZIP2, "bzip2", bzip2::bound, bzip2::compress, bzip2::decompress, nullptr, nullptr },
+        { Compressor::LZ4,   "lz4",   lz4::bound,   lz4::compress,   lz4::decompress, lz4::compress, lz4::decompress },
+        { Compressor::LZO,   "lzo",   lzo::bound,   lzo::compress,   lzo::decompress, nullptr, nullptr },
+        { Compressor::ZSTD,  "zstd",  zstd::bound,  zstd::compress,  zstd::decompress, zstd::compress, zstd::decompress },
+        { Compressor::LZFSE, "lzfse", lzfse::bound, lzfse::compress, lzfse::decompress, nullptr, nullptr },
+        { Compressor::LZMA,  "lzma",  lzma::bound,  lzma::compress,  lzma::decompress, nullptr, nullptr },
+        { Compressor::LZMA2, "lzma2", lzma2::bound, lzma2::compress, lzma2::decompress, nullptr, nullptr },
+        { Compressor::PPMD8, "ppmd8", ppmd8::bound, ppmd8::compress, ppmd8::decompress, nullptr, nullptr },
+        { Compressor::DEFLATE, "deflate", deflate::bound, deflate::compress, deflate::decompress, nullptr, nullptr },
+        { Compressor::ZLIB, "zlib", zlib::bound, zlib::compress, zlib::decompress, nullptr, nullptr },
+        { Compressor::GZIP, "gzip", gzip::bound, gzip::compress, gzip::decompress, nullptr, nullptr },
     };
 
     std::vector<Compressor> getCompressors()
@@ -1077,4 +1719,413 @@ namespace gzip {
         return compressor;
     }
 
+    // ----------------------------------------------------------------------------
+    // compression contexts
+    // ----------------------------------------------------------------------------
+
+    namespace
+    {
+
+        // stateless methods call the memory block compression functions
+
+        class CompressContextFunction : public CompressContext
+        {
+        protected:
+            size_t (*m_compress)(Memory dest, ConstMemory source, int level);
+
+        public:
+            CompressContextFunction(const Compressor& compressor)
+                : m_compress(compressor.compress)
+            {
+            }
+
+            size_t compress(Memory dest, ConstMemory source, int level) override
+            {
+                return m_compress(dest, source, level);
+            }
+        };
+
+        class DecompressContextFunction : public DecompressContext
+        {
+        protected:
+            size_t (*m_decompress)(Memory dest, ConstMemory source);
+
+        public:
+            DecompressContextFunction(const Compressor& compressor)
+                : m_decompress(compressor.decompress)
+            {
+            }
+
+            size_t decompress(Memory dest, ConstMemory source) override
+            {
+                return m_decompress(dest, source);
+            }
+        };
+
+        struct ThreadContextCache
+        {
+            std::unique_ptr<CompressContext> compress[Compressor::GZIP + 1];
+            std::unique_ptr<DecompressContext> decompress[Compressor::GZIP + 1];
+        };
+
+        thread_local ThreadContextCache g_thread_contexts;
+
+        void validate_method(Compressor::Method method)
+        {
+            if (u32(method) > Compressor::GZIP)
+            {
+                MANGO_EXCEPTION("[Compressor] Incorrect method (%d).", int(method));
+            }
+        }
+
+    } // namespace
+
+    std::unique_ptr<CompressContext> createCompressContext(Compressor::Method method)
+    {
+        validate_method(method);
+
+        CompressContext* context = nullptr;
+
+        switch (method)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::LZ4:
+                context = new lz4::CompressContextLZ4();
+                break;
+            case Compressor::LZO:
+                context = new lzo::CompressContextLZO();
+                break;
+            case Compressor::ZSTD:
+                context = new zstd::CompressContextZSTD();
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::LZFSE:
+                context = new lzfse::CompressContextLZFSE();
+                break;
+#endif
+            case Compressor::LZMA:
+                context = new lzma::CompressContextLZMA();
+                break;
+            case Compressor::DEFLATE:
+                context = new deflate::CompressContextDeflate(deflate::Format::DEFLATE);
+                break;
+            case Compressor::ZLIB:
+                context = new deflate::CompressContextDeflate(deflate::Format::ZLIB);
+                break;
+            case Compressor::GZIP:
+                context = new deflate::CompressContextDeflate(deflate::Format::GZIP);
+                break;
+            default:
+                context = new CompressContextFunction(getCompressor(method));
+                break;
+        }
+
+        return std::unique_ptr<CompressContext>(context);
+    }
+
+    std::unique_ptr<DecompressContext> createDecompressContext(Compressor::Method method)
+    {
+        validate_method(method);
+
+        DecompressContext* context = nullptr;
+
+        switch (method)
+        {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::ZSTD:
+                context = new zstd::DecompressContextZSTD();
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::LZFSE:
+                context = new lzfse::DecompressContextLZFSE();
+                break;
+#endif
+            case Compressor::LZMA:
+                context = new lzma::DecompressContextLZMA();
+                break;
+            case Compressor::DEFLATE:
+                context = new deflate::DecompressContextDeflate(deflate::Format::DEFLATE);
+                break;
+            case Compressor::ZLIB:
+                context = new deflate::DecompressContextDeflate(deflate::Format::ZLIB);
+                break;
+            case Compressor::GZIP:
+                context = new deflate::DecompressContextDeflate(deflate::Format::GZIP);
+                break;
+            default:
+                context = new DecompressContextFunction(getCompressor(method));
+                break;
+        }
+
+        return std::unique_ptr<DecompressContext>(context);
+    }
+
+    CompressContext& getThreadCompressContext(Compressor::Method method)
+    {
+        validate_method(method);
+
+        std::unique_ptr<CompressContext>& context = g_thread_contexts.compress[method];
+        if (!context)
+        {
+            context = createCompressContext(method);
+        }
+
+        return *context;
+    }
+
+    DecompressContext& getThreadDecompressContext(Compressor::Method method)
+    {
+        validate_method(method);
+
+        std::unique_ptr<DecompressContext>& context = g_thread_contexts.decompress[method];
+        if (!context)
+        {
+            context = createDecompressContext(method);
+        }
+
+        return *context;
+    }
+
+    // ----------------------------------------------------------------------------
+    // parallel compression
+    // ----------------------------------------------------------------------------
+
+    /*
+        Frame layout (little endian):
+
+        u32     magic ('m', 'p', 'z', '1')
+        u32     method
+        u64     decompressed size
+        u32     block size
+        u32     block count
+        u32     compressed size of each block (== decompressed size: stored block)
+        ...     blocks
+    */
+
+    namespace
+    {
+
+        const u32 parallel_magic = u32_mask('m', 'p', 'z', '1');
+        const size_t parallel_header_size = 24;
+
+        size_t parallel_block_size(size_t block_size)
+        {
+            return clamp(block_size, size_t(64 * 1024), size_t(1024 * 1024 * 1024));
+        }
+
+        size_t parallel_block_bound(const Compressor& compressor, size_t block_size)
+        {
+            return std::max(compressor.bound(block_size), block_size);
+        }
+
+        struct ParallelFrame
+        {
+            Compressor::Method method;
+            u64 size;
+            size_t block_size;
+            size_t block_count;
+            const u8* sizes;
+            const u8* data;
+
+            ParallelFrame(ConstMemory source)
+            {
+                LittleEndianConstPointer p = source.address;
+
+                if (source.size < parallel_header_size || p.read32() != parallel_magic)
+                {
+                    MANGO_EXCEPTION("[parallel_decompress] Incorrect frame header.");
+                }
+
+                u32 value = p.read32();
+                size = p.read64();
+                block_size = p.read32();
+                block_count = p.read32();
+
+                if (value > Compressor::GZIP)
+                {
+                    MANGO_EXCEPTION("[parallel_decompress] Incorrect method (%d).", value);
+                }
+
+                method = Compressor::Method(value);
+
+                if (!block_size || (size + block_size - 1) / block_size != block_count ||
+                    (source.size - parallel_header_size) / 4 < block_count)
+                {
+                    MANGO_EXCEPTION("[parallel_decompress] Incorrect frame header.");
+                }
+
+                sizes = source.address + parallel_header_size;
+                data = sizes + block_count * 4;
+            }
+        };
+
+    } // namespace
+
+    size_t parallel_bound(const Compressor& compressor, size_t size, size_t block_size)
+    {
+        block_size = parallel_block_size(block_size);
+        const size_t count = (size + block_size - 1) / block_size;
+        return parallel_header_size + count * (4 + parallel_block_bound(compressor, block_size));
+    }
+
+    size_t parallel_compress(const Compressor& compressor, Memory dest, ConstMemory source, int level, size_t block_size)
+    {
+        block_size = parallel_block_size(block_size);
+        const size_t count = (source.size + block_size - 1) / block_size;
+
+        if (count > 0xffffffff)
+        {
+            MANGO_EXCEPTION("[parallel_compress] Too many blocks (%d).", int(count));
+        }
+
+        if (dest.size < parallel_bound(compressor, source.size, block_size))
+        {
+            MANGO_EXCEPTION("[parallel_compress] Not enough space in destination.");
+        }
+
+        LittleEndianPointer p = dest.address;
+        p.write32(parallel_magic);
+        p.write32(compressor.method);
+        p.write64(source.size);
+        p.write32(u32(block_size));
+        p.write32(u32(count));
+
+        u8* sizes = dest.address + parallel_header_size;
+        u8* output = sizes + count * 4;
+
+        // The blocks are compressed in any order into temporary buffers which
+        // are appended into the destination in order by the TicketQueue. The
+        // queue grows when all tickets are in use, so the capacity is only the
+        // number of tickets allocated at a time and does not bound the buffers
+        // waiting to be appended.
+        const size_t threads = size_t(ThreadPool::getInstanceSize());
+        ConcurrentQueue q("parallel_compress", Priority::HIGH);
+        TicketQueue tk(std::max(threads * 4, size_t(16)));
+
+        std::atomic<bool> failed { false };
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t offset = i * block_size;
+            ConstMemory block(source.address + offset, std::min(block_size, source.size - offset));
+
+            auto ticket = tk.acquire();
+
+            q.enqueue([=, &compressor, &output, &failed]
+            {
+                std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>(parallel_block_bound(compressor, block.size));
+
+                size_t bytes = 0;
+
+                try
+                {
+                    bytes = getThreadCompressContext(compressor.method).compress(*buffer, block, level);
+                }
+                catch (...)
+                {
+                    failed = true;
+                }
+
+                ticket.consume([=, &output]
+                {
+                    ConstMemory memory(*buffer, bytes);
+
+                    if (!bytes || bytes >= block.size)
+                    {
+                        // store incompressible block
+                        memory = block;
+                    }
+
+                    std::memcpy(output, memory.address, memory.size);
+                    ustore32le(sizes + i * 4, u32(memory.size));
+                    output += memory.size;
+                });
+            });
+        }
+
+        q.wait();
+        tk.wait();
+
+        if (failed)
+        {
+            MANGO_EXCEPTION("[parallel_compress] %s compression failed.", compressor.name.c_str());
+        }
+
+        return output - dest.address;
+    }
+
+    u64 parallel_decompress_size(ConstMemory source)
+    {
+        ParallelFrame frame(source);
+        return frame.size;
+    }
+
+    size_t parallel_decompress(Memory dest, ConstMemory source)
+    {
+        ParallelFrame frame(source);
+
+        if (dest.size < frame.size)
+        {
+            MANGO_EXCEPTION("[parallel_decompress] Not enough space in destination.");
+        }
+
+        Compressor compressor = getCompressor(frame.method);
+
+        const u8* end = source.address + source.size;
+        const u8* input = frame.data;
+
+        ConcurrentQueue q("parallel_decompress", Priority::HIGH);
+        std::atomic<bool> failed { false };
+
+        for (size_t i = 0; i < frame.block_count; ++i)
+        {
+            const size_t offset = i * frame.block_size;
+            Memory output(dest.address + offset, size_t(std::min(u64(frame.block_size), frame.size - offset)));
+
+            const size_t bytes = uload32le(frame.sizes + i * 4);
+            if (size_t(end - input) < bytes)
+            {
+                failed = true;
+                break;
+            }
+
+            ConstMemory block(input, bytes);
+            input += bytes;
+
+            q.enqueue([=, &compressor, &failed]
+            {
+                if (block.size == output.size)
+                {
+                    // stored block
+                    std::memcpy(output.address, block.address, block.size);
+                    return;
+                }
+
+                try
+                {
+                    size_t bytes = getThreadDecompressContext(compressor.method).decompress(output, block);
+                    if (bytes != output.size)
+                    {
+                        failed = true;
+                    }
+                }
+                catch (...)
+                {
+                    failed = true;
+                }
+            });
+        }
+
+        q.wait();
+
+        if (failed)
+        {
+            MANGO_EXCEPTION("[parallel_decompress] %s decompression failed.", compressor.name.c_str());
+        }
+
+        return size_t(frame.size);
+    }
+
 } // namespace mango
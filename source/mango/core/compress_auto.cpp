@@ -0,0 +1,278 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cmath>
+#include <algorithm>
+#include <mango/core/compress.hpp>
+#include <mango/core/endian.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // candidates
+    // ----------------------------------------------------------------------------
+
+    // The compressed size is predicted as a fraction of the source size:
+    //
+    //     size = (1 - matches * match) * (coded ? entropy / 8 * literal : 1)
+    //
+    // where match is how much of the matched data the method removes and literal is
+    // how close the entropy coder gets to the order-0 entropy. The speeds are rough
+    // compression throughput figures (MB/s) for one core; only their order matters.
+
+    struct Candidate
+    {
+        Compressor::Method method;
+        int level;
+        float speed;
+        bool coded;
+        bool text;
+        float match;
+        float literal;
+    };
+
+    const Candidate g_candidates[] =
+    {
+#ifdef MANGO_ENABLE_LICENSE_BSD
+        { Compressor::LZ4,     4, 600.0f, false, false, 0.60f, 1.00f },
+        { Compressor::LZ4,     8,  60.0f, false, false, 0.70f, 1.00f },
+        { Compressor::ZSTD,    1, 300.0f, true,  false, 0.70f, 1.00f },
+        { Compressor::ZSTD,    3, 100.0f, true,  false, 0.78f, 1.00f },
+        { Compressor::ZSTD,    6,  30.0f, true,  false, 0.85f, 0.98f },
+        { Compressor::ZSTD,   10,   4.0f, true,  false, 0.90f, 0.97f },
+#endif
+        { Compressor::DEFLATE, 6,  50.0f, true,  false, 0.75f, 1.00f },
+        { Compressor::PPMD8,   6,  15.0f, true,  true,  0.95f, 0.75f },
+        { Compressor::LZMA,    6,   3.0f, true,  false, 0.92f, 0.95f },
+    };
+
+    // blocks smaller than this are stored
+    constexpr size_t min_block_size = 64;
+
+    // the block is sampled in chunks spread over the block
+    constexpr size_t sample_chunk_size = 4096;
+    constexpr size_t sample_chunk_count = 16;
+
+    // data with near maximum entropy and no matches is not compressible
+    constexpr float random_entropy = 7.9f;
+    constexpr float random_matches = 0.01f;
+
+    // compressing is not worth it unless the predicted size is below the threshold
+    constexpr float store_threshold = 0.97f;
+    constexpr float speed_threshold = 0.90f;
+
+    // fraction of printable characters for the block to be considered text
+    constexpr float text_threshold = 0.95f;
+
+    float predict(const Candidate& candidate, const AutoCompressor::Estimate& estimate)
+    {
+        float size = 1.0f - estimate.matches * candidate.match;
+
+        if (candidate.coded)
+        {
+            size *= estimate.entropy / 8.0f * candidate.literal;
+        }
+
+        return size;
+    }
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // AutoCompressor
+    // ----------------------------------------------------------------------------
+
+    AutoCompressor::AutoCompressor(Goal goal, float budget)
+        : m_goal(goal)
+        , m_budget(budget)
+    {
+    }
+
+    AutoCompressor::~AutoCompressor()
+    {
+    }
+
+    AutoCompressor::Estimate AutoCompressor::estimate(ConstMemory source)
+    {
+        u32 histogram[256] = { 0 };
+        const u8* table[4096] = { nullptr };
+
+        size_t count = 0;
+        size_t probes = 0;
+        size_t hits = 0;
+
+        // small blocks are sampled completely
+        size_t chunks = 1;
+        size_t chunk_size = source.size;
+
+        if (source.size > sample_chunk_size * sample_chunk_count)
+        {
+            chunks = sample_chunk_count;
+            chunk_size = sample_chunk_size;
+        }
+
+        const size_t stride = source.size / chunks;
+
+        for (size_t i = 0; i < chunks; ++i)
+        {
+            const u8* p = source.address + i * stride;
+
+            for (size_t j = 0; j < chunk_size; ++j)
+            {
+                ++histogram[p[j]];
+            }
+
+            count += chunk_size;
+
+            // probe for repeated 4 byte sequences
+            for (size_t j = 0; j + 4 <= chunk_size; ++j)
+            {
+                const u32 value = uload32(p + j);
+                const u32 h = (value * 2654435761u) >> 20;
+
+                if (table[h] && uload32(table[h]) == value)
+                {
+                    ++hits;
+                }
+
+                table[h] = p + j;
+                ++probes;
+            }
+        }
+
+        Estimate estimate = { 8.0f, 0.0f, 0.0f };
+
+        if (count)
+        {
+            float entropy = 0.0f;
+            size_t printable = 0;
+
+            for (int i = 0; i < 256; ++i)
+            {
+                if (histogram[i])
+                {
+                    float p = float(histogram[i]) / float(count);
+                    entropy -= p * std::log2(p);
+                }
+
+                if ((i >= 32 && i < 127) || i == '\t' || i == '\n' || i == '\r')
+                {
+                    printable += histogram[i];
+                }
+            }
+
+            estimate.entropy = entropy;
+            estimate.text = float(printable) / float(count);
+        }
+
+        if (probes)
+        {
+            estimate.matches = float(hits) / float(probes);
+        }
+
+        return estimate;
+    }
+
+    AutoCompressor::Selection AutoCompressor::select(ConstMemory source) const
+    {
+        Selection selection = { Compressor::NONE, 0 };
+
+        if (source.size < min_block_size)
+        {
+            return selection;
+        }
+
+        const Estimate estimate = AutoCompressor::estimate(source);
+
+        if (estimate.entropy > random_entropy && estimate.matches < random_matches)
+        {
+            return selection;
+        }
+
+        const Candidate* best = nullptr;
+        float best_size = store_threshold;
+
+        for (const Candidate& candidate : g_candidates)
+        {
+            if (candidate.text && estimate.text < text_threshold)
+            {
+                // context modeling is selected only for text
+                continue;
+            }
+
+            const float size = predict(candidate, estimate);
+
+            if (m_goal == SPEED)
+            {
+                // fastest candidate which saves enough space
+                if (size < speed_threshold && (!best || candidate.speed > best->speed))
+                {
+                    best = &candidate;
+                }
+            }
+            else
+            {
+                // smallest candidate within the budget
+                if (candidate.speed >= m_budget && size < best_size)
+                {
+                    best = &candidate;
+                    best_size = size;
+                }
+            }
+        }
+
+        if (best)
+        {
+            selection.method = best->method;
+            selection.level = best->level;
+        }
+
+        return selection;
+    }
+
+    size_t AutoCompressor::bound(size_t size) const
+    {
+        size_t bytes = nocompress::bound(size);
+
+        for (const Candidate& candidate : g_candidates)
+        {
+            Compressor compressor = getCompressor(candidate.method);
+            bytes = std::max(bytes, compressor.bound(size));
+        }
+
+        return bytes;
+    }
+
+    AutoCompressor::Result AutoCompressor::compress(Memory dest, ConstMemory source) const
+    {
+        Selection selection = select(source);
+
+        Result result;
+        result.method = selection.method;
+        result.level = selection.level;
+        result.size = 0;
+
+        if (selection.method != Compressor::NONE)
+        {
+            CompressContext& context = getThreadCompressContext(selection.method);
+            result.size = context.compress(dest, source, selection.level);
+        }
+
+        if (!result.size || result.size >= source.size)
+        {
+            // the block was not compressed or did not shrink; store it
+            result.method = Compressor::NONE;
+            result.level = 0;
+            result.size = nocompress::compress(dest, source);
+        }
+
+        return result;
+    }
+
+} // namespace mango
@@ -0,0 +1,247 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <atomic>
+#include <mango/core/compress.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/exception.hpp>
+
+namespace
+{
+    using namespace mango;
+
+    // ----------------------------------------------------------------------------
+    // dictionary trainer
+    // ----------------------------------------------------------------------------
+
+    // The trainer is a variant of the COVER algorithm (Liao, Petri, Moffat, Wirth:
+    // "Effective Construction of Relative Lempel-Ziv Dictionaries"). The samples are
+    // divided into epochs and the segment with highest score is selected from each
+    // epoch in turn. The score of a segment is the sum of frequencies of the distinct
+    // d-mers in it; the frequencies of the selected d-mers are cleared so that the
+    // following segments cover new content. The d-mer frequencies are counted in a
+    // hashed table so the memory usage does not depend on the sample size.
+
+    constexpr int    dmer_size = 8;
+    constexpr int    table_bits = 20;
+    constexpr size_t segment_size = 256;
+
+    struct Segment
+    {
+        size_t begin;
+        size_t end;
+        u64 score;
+    };
+
+    class DictionaryTrainer
+    {
+    protected:
+        ConstMemory m_samples;
+        size_t m_count; // number of d-mers
+        std::vector<u32> m_frequency;
+        std::vector<u16> m_active;
+
+        static inline u32 hash(const u8* p)
+        {
+            return u32((uload64(p) * 0xcf1bbcdcb7a56463ull) >> (64 - table_bits));
+        }
+
+    public:
+        DictionaryTrainer(ConstMemory samples)
+            : m_samples(samples)
+            , m_count(samples.size - dmer_size + 1)
+            , m_frequency(size_t(1) << table_bits, 0)
+            , m_active(size_t(1) << table_bits, 0)
+        {
+            for (size_t i = 0; i < m_count; ++i)
+            {
+                ++m_frequency[hash(m_samples.address + i)];
+            }
+        }
+
+        size_t count() const
+        {
+            return m_count;
+        }
+
+        // select the best segment starting in the range [begin, end)
+        Segment select(size_t begin, size_t end)
+        {
+            const u8* data = m_samples.address;
+
+            const size_t window = segment_size - dmer_size + 1;
+
+            Segment best = { begin, begin, 0 };
+
+            size_t first = begin;
+            u64 score = 0;
+
+            for (size_t i = begin; i < end; ++i)
+            {
+                u32 h = hash(data + i);
+                if (m_active[h]++ == 0)
+                {
+                    score += m_frequency[h];
+                }
+
+                if (i - first + 1 > window)
+                {
+                    u32 g = hash(data + first);
+                    if (--m_active[g] == 0)
+                    {
+                        score -= m_frequency[g];
+                    }
+                    ++first;
+                }
+
+                if (score > best.score)
+                {
+                    best.begin = first;
+                    best.end = i + 1;
+                    best.score = score;
+                }
+            }
+
+            // clear the window
+            for (size_t i = first; i < end; ++i)
+            {
+                m_active[hash(data + i)] = 0;
+            }
+
+            if (best.score)
+            {
+                // trim d-mers which do not contribute to the score
+                while (best.begin < best.end && !m_frequency[hash(data + best.begin)])
+                {
+                    ++best.begin;
+                }
+
+                while (best.end > best.begin && !m_frequency[hash(data + best.end - 1)])
+                {
+                    --best.end;
+                }
+
+                // the selected d-mers are covered by the dictionary
+                for (size_t i = best.begin; i < best.end; ++i)
+                {
+                    m_frequency[hash(data + i)] = 0;
+                }
+            }
+
+            return best;
+        }
+    };
+
+} // namespace
+
+namespace mango
+{
+
+    // ----------------------------------------------------------------------------
+    // Dictionary
+    // ----------------------------------------------------------------------------
+
+    Dictionary::Dictionary()
+        : m_id(0)
+    {
+    }
+
+    Dictionary::Dictionary(ConstMemory memory)
+        : m_memory(memory)
+    {
+        static std::atomic<u64> next_id { 0 };
+        m_id = ++next_id;
+    }
+
+    // ----------------------------------------------------------------------------
+    // train_dictionary()
+    // ----------------------------------------------------------------------------
+
+    size_t train_dictionary(Memory dest, const std::vector<ConstMemory>& samples)
+    {
+        size_t total = 0;
+
+        for (auto sample : samples)
+        {
+            total += sample.size;
+        }
+
+        if (total <= dest.size)
+        {
+            // the samples fit into the dictionary as-is
+            u8* p = dest.address;
+
+            for (auto sample : samples)
+            {
+                std::memcpy(p, sample.address, sample.size);
+                p += sample.size;
+            }
+
+            return total;
+        }
+
+        if (dest.size < segment_size)
+        {
+            MANGO_EXCEPTION("[train_dictionary] Dictionary capacity is too small.");
+        }
+
+        Buffer buffer;
+        buffer.reserve(total);
+
+        for (auto sample : samples)
+        {
+            buffer.append(sample.address, sample.size);
+        }
+
+        DictionaryTrainer trainer(buffer);
+
+        // the samples are split into epochs which are visited in turn
+        size_t epochs = std::max(size_t(1), dest.size / segment_size / 4);
+        size_t epoch_size = trainer.count() / epochs;
+
+        if (epoch_size < segment_size)
+        {
+            epochs = std::max(size_t(1), trainer.count() / segment_size);
+            epoch_size = trainer.count() / epochs;
+        }
+
+        const size_t max_zero_score_run = std::min(size_t(100), std::max(size_t(10), epochs));
+        size_t zero_score_run = 0;
+
+        // the dictionary is filled from the end so that the segments selected first
+        // are closest to the compressed data
+        size_t tail = dest.size;
+
+        for (size_t epoch = 0; tail > 0; epoch = (epoch + 1) % epochs)
+        {
+            const size_t begin = epoch * epoch_size;
+            const size_t end = epoch + 1 < epochs ? begin + epoch_size : trainer.count();
+
+            Segment segment = trainer.select(begin, end);
+            if (!segment.score)
+            {
+                if (++zero_score_run >= max_zero_score_run)
+                    break;
+                continue;
+            }
+
+            zero_score_run = 0;
+
+            size_t size = std::min(segment.end - segment.begin + dmer_size - 1, tail);
+            if (size < dmer_size)
+                break;
+
+            tail -= size;
+            std::memcpy(dest.address + tail, buffer.data() + segment.begin, size);
+        }
+
+        size_t size = dest.size - tail;
+        std::memmove(dest.address, dest.address + tail, size);
+
+        return size;
+    }
+
+} // namespace mango
@@ -0,0 +1,1609 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <algorithm>
+#include <mango/core/compress.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/buffer.hpp>
+#include <mango/core/endian.hpp>
+#include <mango/math/math.hpp>
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+#include "../../external/zstd/zstd.h"
+#endif
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+#include "../../external/bzip2/bzlib.h"
+#endif
+
+#include "../../external/libdeflate/libdeflate.h"
+
+namespace
+{
+    using namespace mango;
+
+    // largest chunk the decoder accepts; protects from allocating memory for garbage
+    const size_t max_window_size = 1024 * 1024 * 1024;
+
+    size_t clamp_window(size_t window)
+    {
+        return clamp(window, size_t(4096), max_window_size);
+    }
+
+    void read_input(Stream& input, void* dest, size_t size)
+    {
+        if (input.size() - input.offset() < size)
+        {
+            MANGO_EXCEPTION("[DecompressStream] Truncated stream.");
+        }
+
+        input.read(dest, size);
+    }
+
+    size_t read_some(Stream& input, void* dest, size_t size)
+    {
+        size = size_t(std::min(u64(size), input.size() - input.offset()));
+        input.read(dest, size);
+        return size;
+    }
+
+} // namespace
+
+namespace mango
+{
+
+    // -----------------------------------------------------------------
+    // CompressStreamHandle
+    // -----------------------------------------------------------------
+
+    struct CompressStreamHandle
+    {
+        Stream& output;
+        Buffer window;
+        size_t used = 0;
+        u64 offset = 0;
+        bool finished = false;
+
+        CompressStreamHandle(Stream& output, size_t window)
+            : output(output)
+            , window(window)
+        {
+        }
+
+        virtual ~CompressStreamHandle()
+        {
+        }
+
+        // compress source; finish is set on the last call
+        virtual void encode(ConstMemory source, bool finish) = 0;
+    };
+
+    // -----------------------------------------------------------------
+    // DecompressStreamHandle
+    // -----------------------------------------------------------------
+
+    struct DecompressStreamHandle
+    {
+        Stream& input;
+        ConstMemory block;
+        size_t position = 0;
+        u64 offset = 0;
+        u64 decoded = 0;
+
+        DecompressStreamHandle(Stream& input)
+            : input(input)
+        {
+        }
+
+        virtual ~DecompressStreamHandle()
+        {
+        }
+
+        // next block of decompressed data; empty at the end of the stream
+        virtual ConstMemory decode() = 0;
+
+        bool next()
+        {
+            block = decode();
+            position = 0;
+            decoded += block.size;
+            return block.size > 0;
+        }
+    };
+
+namespace
+{
+
+    // -----------------------------------------------------------------
+    // chunk
+    // -----------------------------------------------------------------
+
+    // Each window is an independent chunk compressed with the CompressContext:
+    // u32le compressed size, u32le decompressed size, data.
+
+    struct CompressChunk : CompressStreamHandle
+    {
+        std::unique_ptr<CompressContext> context;
+        Buffer buffer;
+        int level;
+
+        CompressChunk(Stream& output, Compressor::Method method, int level, size_t window)
+            : CompressStreamHandle(output, window)
+            , context(createCompressContext(method))
+            , buffer(8 + getCompressor(method).bound(window))
+            , level(level)
+        {
+        }
+
+        void encode(ConstMemory source, bool finish) override
+        {
+            MANGO_UNREFERENCED(finish);
+
+            if (!source.size)
+                return;
+
+            Memory dest(buffer.data() + 8, buffer.size() - 8);
+            size_t bytes = context->compress(dest, source, level);
+
+            ustore32le(buffer.data() + 4, u32(source.size));
+
+            if (!bytes || bytes >= source.size)
+            {
+                // store incompressible chunk
+                ustore32le(buffer.data() + 0, u32(source.size));
+                output.write(buffer.data(), 8);
+                output.write(source);
+            }
+            else
+            {
+                ustore32le(buffer.data() + 0, u32(bytes));
+                output.write(buffer.data(), 8 + bytes);
+            }
+        }
+    };
+
+    struct DecompressChunk : DecompressStreamHandle
+    {
+        std::unique_ptr<DecompressContext> context;
+        Buffer compressed;
+        Buffer decompressed;
+
+        DecompressChunk(Stream& input, Compressor::Method method)
+            : DecompressStreamHandle(input)
+            , context(createDecompressContext(method))
+        {
+        }
+
+        ConstMemory decode() override
+        {
+            if (input.offset() >= input.size())
+                return ConstMemory();
+
+            u8 header[8];
+            read_input(input, header, 8);
+
+            const size_t compressed_size = uload32le(header + 0);
+            const size_t decompressed_size = uload32le(header + 4);
+
+            if (compressed_size > max_window_size || decompressed_size > max_window_size)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect chunk size.");
+            }
+
+            if (decompressed.size() < decompressed_size)
+            {
+                decompressed.resize(decompressed_size);
+            }
+
+            Memory dest(decompressed.data(), decompressed_size);
+
+            if (compressed_size == decompressed_size)
+            {
+                // stored chunk
+                read_input(input, dest.address, dest.size);
+            }
+            else
+            {
+                if (compressed.size() < compressed_size)
+                {
+                    compressed.resize(compressed_size);
+                }
+
+                read_input(input, compressed.data(), compressed_size);
+
+                size_t bytes = context->decompress(dest, ConstMemory(compressed.data(), compressed_size));
+                if (bytes != decompressed_size)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect chunk size.");
+                }
+            }
+
+            return dest;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // gzip
+    // -----------------------------------------------------------------
+
+    // Every window is a gzip member (RFC 1952). The member size is stored in an
+    // extra field subfield ('M', 'G') so that the decoder knows how much to read;
+    // other gzip decoders skip the field.
+
+    const size_t gzip_header_size = 20;
+
+    struct CompressGzip : CompressStreamHandle
+    {
+        std::unique_ptr<CompressContext> context;
+        Buffer buffer;
+        int level;
+        bool empty = true;
+
+        CompressGzip(Stream& output, int level, size_t window)
+            : CompressStreamHandle(output, window)
+            , context(createCompressContext(Compressor::DEFLATE))
+            , buffer(gzip_header_size + deflate::bound(window) + 8)
+            , level(level)
+        {
+        }
+
+        void encode(ConstMemory source, bool finish) override
+        {
+            // the file must have at least one member
+            if (!source.size && !(finish && empty))
+                return;
+
+            empty = false;
+
+            u8* p = buffer.data();
+            Memory dest(p + gzip_header_size, buffer.size() - gzip_header_size - 8);
+            size_t bytes = context->compress(dest, source, level);
+            size_t member_size = gzip_header_size + bytes + 8;
+
+            p[0] = 0x1f;
+            p[1] = 0x8b;
+            p[2] = 8; // deflate
+            p[3] = 0x04; // FEXTRA
+            ustore32le(p + 4, 0); // MTIME
+            p[8] = 0; // XFL
+            p[9] = 255; // OS: unknown
+            ustore16le(p + 10, 8); // XLEN
+            p[12] = 'M';
+            p[13] = 'G';
+            ustore16le(p + 14, 4);
+            ustore32le(p + 16, u32(member_size));
+
+            u8* trailer = dest.address + bytes;
+            ustore32le(trailer + 0, libdeflate_crc32(0, source.address, source.size));
+            ustore32le(trailer + 4, u32(source.size));
+
+            output.write(p, member_size);
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // inflate
+    // -----------------------------------------------------------------
+
+    // Incremental deflate (RFC 1951) decoder for gzip members which do not store the
+    // member size. libdeflate only decompresses complete buffers so the members of
+    // foreign gzip files, which can be arbitrarily large, are decoded with this.
+
+    class InputReader
+    {
+    protected:
+        Stream& m_input;
+        Buffer m_buffer;
+        size_t m_position = 0;
+        size_t m_end = 0;
+        u64 m_bits = 0;
+        int m_count = 0;
+
+        bool refill()
+        {
+            m_end = read_some(m_input, m_buffer.data(), m_buffer.size());
+            m_position = 0;
+            return m_end > 0;
+        }
+
+        void fill()
+        {
+            while (m_count <= 56)
+            {
+                if (m_position == m_end && !refill())
+                    break;
+                m_bits |= u64(m_buffer.data()[m_position++]) << m_count;
+                m_count += 8;
+            }
+        }
+
+    public:
+        InputReader(Stream& input)
+            : m_input(input)
+            , m_buffer(128 * 1024)
+        {
+        }
+
+        // at least 15 bits are available unless the input ends; the bits
+        // past the end of input are zero
+        u32 peek()
+        {
+            if (m_count < 15)
+            {
+                fill();
+            }
+            return u32(m_bits);
+        }
+
+        int available() const
+        {
+            return m_count;
+        }
+
+        void consume(int bits)
+        {
+            m_bits >>= bits;
+            m_count -= bits;
+        }
+
+        u32 getBits(int bits)
+        {
+            if (m_count < bits)
+            {
+                fill();
+                if (m_count < bits)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Truncated stream.");
+                }
+            }
+
+            u32 value = u32(m_bits & ((u64(1) << bits) - 1));
+            consume(bits);
+            return value;
+        }
+
+        void align()
+        {
+            consume(m_count & 7);
+        }
+
+        bool empty()
+        {
+            return !m_count && m_position == m_end && !refill();
+        }
+
+        // byte aligned read
+        void read(u8* dest, size_t size)
+        {
+            for ( ; size && m_count >= 8; --size)
+            {
+                *dest++ = u8(m_bits);
+                consume(8);
+            }
+
+            while (size)
+            {
+                if (m_position == m_end && !refill())
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Truncated stream.");
+                }
+
+                size_t bytes = std::min(size, m_end - m_position);
+                std::memcpy(dest, m_buffer.data() + m_position, bytes);
+                m_position += bytes;
+                dest += bytes;
+                size -= bytes;
+            }
+        }
+
+        u8 readByte()
+        {
+            u8 value;
+            read(&value, 1);
+            return value;
+        }
+    };
+
+    // deflate back-references reach at most this far and copy at most max_match bytes
+    static const size_t history_size = 32768;
+    static const size_t max_match = 258;
+
+    class Inflater
+    {
+    protected:
+        enum State
+        {
+            HEADER,
+            STORED,
+            HUFFMAN,
+            DONE
+        };
+
+        // the table entries store the code length in the high and the symbol in the low 16 bits
+        struct HuffmanTable
+        {
+            std::vector<u32> entries;
+            int bits = 0;
+
+            void build(const u8* lengths, int count)
+            {
+                int counts[16] = { 0 };
+                for (int i = 0; i < count; ++i)
+                {
+                    ++counts[lengths[i]];
+                }
+
+                counts[0] = 0;
+                bits = 1;
+
+                int left = 1;
+                for (int i = 1; i < 16; ++i)
+                {
+                    left = (left << 1) - counts[i];
+                    if (left < 0)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect deflate code lengths.");
+                    }
+
+                    if (counts[i])
+                    {
+                        bits = i;
+                    }
+                }
+
+                // incomplete codes are allowed; the unused entries are invalid
+                entries.assign(size_t(1) << bits, 0);
+
+                u32 next[16];
+                u32 code = 0;
+                for (int i = 1; i < 16; ++i)
+                {
+                    code = (code + counts[i - 1]) << 1;
+                    next[i] = code;
+                }
+
+                for (int symbol = 0; symbol < count; ++symbol)
+                {
+                    const int length = lengths[symbol];
+                    if (!length)
+                        continue;
+
+                    // the codes are stored bit reversed
+                    u32 c = next[length]++;
+                    u32 reversed = 0;
+                    for (int i = 0; i < length; ++i)
+                    {
+                        reversed = (reversed << 1) | ((c >> i) & 1);
+                    }
+
+                    const u32 entry = (u32(length) << 16) | u32(symbol);
+                    for (u32 i = reversed; i < entries.size(); i += u32(1) << length)
+                    {
+                        entries[i] = entry;
+                    }
+                }
+            }
+        };
+
+        InputReader& m_reader;
+        Buffer m_output; // history + window
+        size_t m_end = 0;
+        State m_state = HEADER;
+        bool m_final = false;
+        size_t m_stored = 0;
+        HuffmanTable m_litlen;
+        HuffmanTable m_distance;
+
+        int decode(const HuffmanTable& table)
+        {
+            const u32 bits = m_reader.peek();
+            const u32 entry = table.entries[bits & ((1u << table.bits) - 1)];
+            const int length = int(entry >> 16);
+
+            if (!length || length > m_reader.available())
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect deflate data.");
+            }
+
+            m_reader.consume(length);
+            return int(entry & 0xffff);
+        }
+
+        void header()
+        {
+            if (m_final)
+            {
+                m_state = DONE;
+                return;
+            }
+
+            m_final = m_reader.getBits(1) != 0;
+            const u32 type = m_reader.getBits(2);
+
+            if (type == 0)
+            {
+                m_reader.align();
+
+                u8 temp[4];
+                m_reader.read(temp, 4);
+
+                const u16 length = uload16le(temp + 0);
+                const u16 inverse = uload16le(temp + 2);
+                if (length != u16(~inverse))
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect deflate stored block.");
+                }
+
+                m_stored = length;
+                m_state = STORED;
+            }
+            else if (type == 1)
+            {
+                u8 lengths[288 + 30];
+                std::memset(lengths + 0, 8, 144);
+                std::memset(lengths + 144, 9, 112);
+                std::memset(lengths + 256, 7, 24);
+                std::memset(lengths + 280, 8, 8);
+                std::memset(lengths + 288, 5, 30);
+
+                m_litlen.build(lengths, 288);
+                m_distance.build(lengths + 288, 30);
+                m_state = HUFFMAN;
+            }
+            else if (type == 2)
+            {
+                dynamic();
+                m_state = HUFFMAN;
+            }
+            else
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect deflate block type.");
+            }
+        }
+
+        void dynamic()
+        {
+            static const u8 order[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+            const int nlen = int(m_reader.getBits(5)) + 257;
+            const int ndist = int(m_reader.getBits(5)) + 1;
+            const int ncode = int(m_reader.getBits(4)) + 4;
+
+            if (nlen > 286 || ndist > 30)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect deflate block header.");
+            }
+
+            u8 lengths[286 + 30] = { 0 };
+
+            for (int i = 0; i < ncode; ++i)
+            {
+                lengths[order[i]] = u8(m_reader.getBits(3));
+            }
+
+            HuffmanTable code;
+            code.build(lengths, 19);
+
+            std::memset(lengths, 0, 19);
+
+            for (int i = 0; i < nlen + ndist; )
+            {
+                int symbol = decode(code);
+                int value = 0;
+                int repeat = 0;
+
+                if (symbol < 16)
+                {
+                    lengths[i++] = u8(symbol);
+                    continue;
+                }
+                else if (symbol == 16)
+                {
+                    if (!i)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect deflate code lengths.");
+                    }
+                    value = lengths[i - 1];
+                    repeat = 3 + int(m_reader.getBits(2));
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + int(m_reader.getBits(3));
+                }
+                else
+                {
+                    repeat = 11 + int(m_reader.getBits(7));
+                }
+
+                if (i + repeat > nlen + ndist)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect deflate code lengths.");
+                }
+
+                std::memset(lengths + i, value, repeat);
+                i += repeat;
+            }
+
+            if (!lengths[256])
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect deflate code lengths.");
+            }
+
+            m_litlen.build(lengths, nlen);
+            m_distance.build(lengths + nlen, ndist);
+        }
+
+        // decode symbols until the end of block or until the output is full
+        size_t huffman(u8* output, size_t position, size_t limit)
+        {
+            static const u16 length_base[] =
+            {
+                3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+            };
+
+            static const u8 length_extra[] =
+            {
+                0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+            };
+
+            static const u16 distance_base[] =
+            {
+                1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+            };
+
+            static const u8 distance_extra[] =
+            {
+                0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+            };
+
+            while (limit - position >= max_match)
+            {
+                int symbol = decode(m_litlen);
+
+                if (symbol < 256)
+                {
+                    output[position++] = u8(symbol);
+                }
+                else if (symbol == 256)
+                {
+                    m_state = HEADER;
+                    break;
+                }
+                else
+                {
+                    symbol -= 257;
+                    if (symbol >= 29)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect deflate length.");
+                    }
+
+                    const size_t length = length_base[symbol] + m_reader.getBits(length_extra[symbol]);
+
+                    int code = decode(m_distance);
+                    if (code >= 30)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect deflate distance.");
+                    }
+
+                    const size_t distance = distance_base[code] + m_reader.getBits(distance_extra[code]);
+                    if (distance > position)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect deflate distance.");
+                    }
+
+                    u8* dest = output + position;
+                    const u8* src = dest - distance;
+
+                    if (distance >= length)
+                    {
+                        std::memcpy(dest, src, length);
+                    }
+                    else
+                    {
+                        // overlapping copy repeats the pattern
+                        for (size_t i = 0; i < length; ++i)
+                        {
+                            dest[i] = src[i];
+                        }
+                    }
+
+                    position += length;
+                }
+            }
+
+            return position;
+        }
+
+    public:
+        Inflater(InputReader& reader, size_t window)
+            : m_reader(reader)
+            , m_output(history_size + std::max(window, max_match * 2))
+        {
+        }
+
+        // start a new deflate stream
+        void reset()
+        {
+            m_end = 0;
+            m_state = HEADER;
+            m_final = false;
+        }
+
+        // next block of decompressed data; empty at the end of the deflate stream
+        ConstMemory inflate()
+        {
+            u8* output = m_output.data();
+            const size_t limit = m_output.size();
+
+            // keep the history for the matches in the next block
+            const size_t keep = std::min(m_end, history_size);
+            std::memmove(output, output + m_end - keep, keep);
+
+            size_t position = keep;
+            bool full = false;
+
+            while (m_state != DONE && !full)
+            {
+                switch (m_state)
+                {
+                    case HEADER:
+                        header();
+                        break;
+
+                    case STORED:
+                    {
+                        const size_t bytes = std::min(m_stored, limit - position);
+                        m_reader.read(output + position, bytes);
+                        position += bytes;
+                        m_stored -= bytes;
+
+                        if (!m_stored)
+                        {
+                            m_state = HEADER;
+                        }
+                        else
+                        {
+                            full = true;
+                        }
+                        break;
+                    }
+
+                    case HUFFMAN:
+                        position = huffman(output, position, limit);
+                        full = m_state == HUFFMAN;
+                        break;
+
+                    case DONE:
+                        break;
+                }
+            }
+
+            if (m_state == DONE)
+            {
+                // the trailer which follows the deflate stream is byte aligned
+                m_reader.align();
+            }
+
+            m_end = position;
+            return ConstMemory(output + keep, position - keep);
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // gzip decoder
+    // -----------------------------------------------------------------
+
+    // The members written by CompressGzip store their size and are decompressed
+    // with libdeflate. Other members (any standard .gz file) are decoded with the
+    // incremental inflater.
+
+    struct DecompressGzip : DecompressStreamHandle
+    {
+        std::unique_ptr<DecompressContext> context;
+        InputReader reader;
+        Inflater inflater;
+        Buffer compressed;
+        Buffer decompressed;
+        bool inflating = false;
+        u32 crc = 0;
+        u32 size = 0;
+
+        DecompressGzip(Stream& input, size_t window)
+            : DecompressStreamHandle(input)
+            , context(createDecompressContext(Compressor::GZIP))
+            , reader(input)
+            , inflater(reader, window)
+        {
+        }
+
+        ConstMemory decode() override
+        {
+            for (;;)
+            {
+                if (inflating)
+                {
+                    ConstMemory memory = inflater.inflate();
+                    if (memory.size)
+                    {
+                        crc = libdeflate_crc32(crc, memory.address, memory.size);
+                        size += u32(memory.size);
+                        return memory;
+                    }
+
+                    // end of member
+                    u8 trailer[8];
+                    reader.read(trailer, 8);
+
+                    if (uload32le(trailer + 0) != crc || uload32le(trailer + 4) != size)
+                    {
+                        MANGO_EXCEPTION("[DecompressStream] Incorrect gzip checksum.");
+                    }
+
+                    inflating = false;
+                    continue;
+                }
+
+                if (reader.empty())
+                {
+                    return ConstMemory();
+                }
+
+                u8 header[gzip_header_size];
+                reader.read(header, 10);
+
+                if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8 || header[3] & 0xe0)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect gzip header.");
+                }
+
+                const u8 flags = header[3];
+
+                if (flags == 0x04)
+                {
+                    reader.read(header + 10, 2);
+                    const size_t xlen = uload16le(header + 10);
+
+                    if (xlen == 8)
+                    {
+                        reader.read(header + 12, 8);
+
+                        if (header[12] == 'M' && header[13] == 'G' && uload16le(header + 14) == 4)
+                        {
+                            ConstMemory memory = decode_member(header);
+                            if (!memory.size)
+                            {
+                                // empty member
+                                continue;
+                            }
+                            return memory;
+                        }
+                    }
+                    else
+                    {
+                        skip(xlen);
+                    }
+                }
+                else
+                {
+                    if (flags & 0x04)
+                    {
+                        // FEXTRA
+                        u8 temp[2];
+                        reader.read(temp, 2);
+                        skip(uload16le(temp));
+                    }
+
+                    if (flags & 0x08)
+                    {
+                        // FNAME
+                        while (reader.readByte())
+                        {
+                        }
+                    }
+
+                    if (flags & 0x10)
+                    {
+                        // FCOMMENT
+                        while (reader.readByte())
+                        {
+                        }
+                    }
+
+                    if (flags & 0x02)
+                    {
+                        // FHCRC
+                        skip(2);
+                    }
+                }
+
+                inflater.reset();
+                inflating = true;
+                crc = 0;
+                size = 0;
+            }
+        }
+
+        void skip(size_t bytes)
+        {
+            u8 temp[256];
+            while (bytes)
+            {
+                size_t n = std::min(bytes, sizeof(temp));
+                reader.read(temp, n);
+                bytes -= n;
+            }
+        }
+
+        ConstMemory decode_member(const u8* header)
+        {
+            const size_t member_size = uload32le(header + 16);
+            if (member_size < gzip_header_size + 8 || member_size > max_window_size)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect gzip member size.");
+            }
+
+            if (compressed.size() < member_size)
+            {
+                compressed.resize(member_size);
+            }
+
+            std::memcpy(compressed.data(), header, gzip_header_size);
+            reader.read(compressed.data() + gzip_header_size, member_size - gzip_header_size);
+
+            const size_t decompressed_size = uload32le(compressed.data() + member_size - 4);
+            if (decompressed_size > max_window_size)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect gzip member size.");
+            }
+
+            if (decompressed.size() < decompressed_size)
+            {
+                decompressed.resize(decompressed_size);
+            }
+
+            Memory dest(decompressed.data(), decompressed_size);
+            size_t bytes = context->decompress(dest, ConstMemory(compressed.data(), member_size));
+            if (bytes != decompressed_size)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Incorrect gzip member size.");
+            }
+
+            return dest;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // deflate / zlib decoder
+    // -----------------------------------------------------------------
+
+    // Standard raw deflate (RFC 1951) and zlib (RFC 1950) streams are decoded with
+    // the incremental inflater.
+
+    bool is_zlib_header(const u8* header)
+    {
+        // CM = 8 (deflate), CINFO <= 7 (window size) and the header check bits
+        return (header[0] & 0x0f) == 8 && (header[0] >> 4) <= 7 && (header[0] * 256 + header[1]) % 31 == 0;
+    }
+
+    // The zlib chunks written by CompressStream start with the chunk sizes and the
+    // compressed chunks have a zlib header of their own after them; the input is
+    // a standard zlib stream when it starts with a header but not with a chunk.
+    bool is_zlib_stream(Stream& input)
+    {
+        const u64 offset = input.offset();
+        const u64 available = input.size() - offset;
+
+        u8 header[10];
+        const size_t bytes = read_some(input, header, 10);
+        input.seek(offset, Stream::BEGIN);
+
+        if (bytes < 2 || !is_zlib_header(header))
+        {
+            return false;
+        }
+
+        if (bytes == 10)
+        {
+            const size_t compressed_size = uload32le(header + 0);
+            const size_t decompressed_size = uload32le(header + 4);
+
+            const bool chunk = compressed_size <= decompressed_size &&
+                               decompressed_size <= max_window_size &&
+                               compressed_size + 8 <= available &&
+                               (compressed_size == decompressed_size || is_zlib_header(header + 8));
+            if (chunk)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    struct DecompressDeflate : DecompressStreamHandle
+    {
+        InputReader reader;
+        Inflater inflater;
+        bool zlib;
+        bool header;
+        bool done = false;
+        u32 adler = 1;
+
+        DecompressDeflate(Stream& input, size_t window, bool zlib)
+            : DecompressStreamHandle(input)
+            , reader(input)
+            , inflater(reader, window)
+            , zlib(zlib)
+            , header(zlib)
+        {
+        }
+
+        ConstMemory decode() override
+        {
+            if (done)
+            {
+                return ConstMemory();
+            }
+
+            if (header)
+            {
+                u8 temp[2];
+                reader.read(temp, 2);
+
+                if (!is_zlib_header(temp))
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect zlib header.");
+                }
+
+                if (temp[1] & 0x20)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] zlib preset dictionary is not supported.");
+                }
+
+                header = false;
+            }
+
+            ConstMemory memory = inflater.inflate();
+            if (memory.size)
+            {
+                if (zlib)
+                {
+                    adler = libdeflate_adler32(adler, memory.address, memory.size);
+                }
+                return memory;
+            }
+
+            done = true;
+
+            if (zlib)
+            {
+                u8 trailer[4];
+                reader.read(trailer, 4);
+
+                if (uload32be(trailer) != adler)
+                {
+                    MANGO_EXCEPTION("[DecompressStream] Incorrect zlib checksum.");
+                }
+            }
+
+            return ConstMemory();
+        }
+    };
+
+#ifdef MANGO_ENABLE_LICENSE_BSD
+
+    // -----------------------------------------------------------------
+    // zstd
+    // -----------------------------------------------------------------
+
+    struct CompressZSTD : CompressStreamHandle
+    {
+        ZSTD_CCtx* context;
+        Buffer buffer;
+
+        CompressZSTD(Stream& output, int level, size_t window)
+            : CompressStreamHandle(output, window)
+            , buffer(ZSTD_CStreamOutSize())
+        {
+            context = ZSTD_createCCtx();
+            ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, clamp(level * 2, 1, 20));
+        }
+
+        ~CompressZSTD()
+        {
+            ZSTD_freeCCtx(context);
+        }
+
+        void encode(ConstMemory source, bool finish) override
+        {
+            ZSTD_inBuffer in = { source.address, source.size, 0 };
+            ZSTD_EndDirective mode = finish ? ZSTD_e_end : ZSTD_e_continue;
+
+            for (;;)
+            {
+                ZSTD_outBuffer out = { buffer.data(), buffer.size(), 0 };
+
+                size_t remaining = ZSTD_compressStream2(context, &out, &in, mode);
+                if (ZSTD_isError(remaining))
+                {
+                    MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(remaining));
+                }
+
+                output.write(out.dst, out.pos);
+
+                bool done = finish ? remaining == 0 : in.pos == in.size;
+                if (done)
+                    break;
+            }
+        }
+    };
+
+    struct DecompressZSTD : DecompressStreamHandle
+    {
+        ZSTD_DCtx* context;
+        Buffer compressed;
+        Buffer decompressed;
+        ZSTD_inBuffer in;
+        size_t status = 0;
+
+        DecompressZSTD(Stream& input, size_t window)
+            : DecompressStreamHandle(input)
+            , compressed(ZSTD_DStreamInSize())
+            , decompressed(window)
+        {
+            context = ZSTD_createDCtx();
+            in = { compressed.data(), 0, 0 };
+        }
+
+        ~DecompressZSTD()
+        {
+            ZSTD_freeDCtx(context);
+        }
+
+        ConstMemory decode() override
+        {
+            ZSTD_outBuffer out = { decompressed.data(), decompressed.size(), 0 };
+
+            while (out.pos < out.size)
+            {
+                if (in.pos == in.size)
+                {
+                    in.size = read_some(input, compressed.data(), compressed.size());
+                    in.pos = 0;
+
+                    if (!in.size)
+                    {
+                        if (status)
+                        {
+                            MANGO_EXCEPTION("[zstd] Truncated stream.");
+                        }
+                        break;
+                    }
+                }
+
+                status = ZSTD_decompressStream(context, &out, &in);
+                if (ZSTD_isError(status))
+                {
+                    MANGO_EXCEPTION("[zstd] %s", ZSTD_getErrorName(status));
+                }
+            }
+
+            return ConstMemory(decompressed.data(), out.pos);
+        }
+    };
+
+#endif // MANGO_ENABLE_LICENSE_BSD
+
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+
+    // -----------------------------------------------------------------
+    // bzip2
+    // -----------------------------------------------------------------
+
+    struct CompressBZIP2 : CompressStreamHandle
+    {
+        bz_stream strm;
+        Buffer buffer;
+
+        CompressBZIP2(Stream& output, int level, size_t window)
+            : CompressStreamHandle(output, window)
+            , buffer(128 * 1024)
+        {
+            strm.bzalloc = nullptr;
+            strm.bzfree = nullptr;
+            strm.opaque = nullptr;
+
+            const int blockSize100k = clamp(level, 1, 9);
+            if (BZ2_bzCompressInit(&strm, blockSize100k, 0, 30) != BZ_OK)
+            {
+                MANGO_EXCEPTION("[bzip2] compression failed.");
+            }
+        }
+
+        ~CompressBZIP2()
+        {
+            BZ2_bzCompressEnd(&strm);
+        }
+
+        void encode(ConstMemory source, bool finish) override
+        {
+            strm.next_in = const_cast<char*>(source.cast<const char>());
+            strm.avail_in = static_cast<unsigned int>(source.size);
+
+            const int action = finish ? BZ_FINISH : BZ_RUN;
+
+            for (;;)
+            {
+                strm.next_out = reinterpret_cast<char*>(buffer.data());
+                strm.avail_out = static_cast<unsigned int>(buffer.size());
+
+                int x = BZ2_bzCompress(&strm, action);
+                if (x != BZ_RUN_OK && x != BZ_FINISH_OK && x != BZ_STREAM_END)
+                {
+                    MANGO_EXCEPTION("[bzip2] compression failed.");
+                }
+
+                output.write(buffer.data(), buffer.size() - strm.avail_out);
+
+                bool done = finish ? x == BZ_STREAM_END : strm.avail_in == 0;
+                if (done)
+                    break;
+            }
+        }
+    };
+
+    struct DecompressBZIP2 : DecompressStreamHandle
+    {
+        bz_stream strm;
+        Buffer compressed;
+        Buffer decompressed;
+        bool active = true;
+
+        DecompressBZIP2(Stream& input, size_t window)
+            : DecompressStreamHandle(input)
+            , compressed(128 * 1024)
+            , decompressed(window)
+        {
+            strm.bzalloc = nullptr;
+            strm.bzfree = nullptr;
+            strm.opaque = nullptr;
+            strm.next_in = nullptr;
+            strm.avail_in = 0;
+
+            if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+            {
+                MANGO_EXCEPTION("[bzip2] decompression failed.");
+            }
+        }
+
+        ~DecompressBZIP2()
+        {
+            BZ2_bzDecompressEnd(&strm);
+        }
+
+        ConstMemory decode() override
+        {
+            strm.next_out = reinterpret_cast<char*>(decompressed.data());
+            strm.avail_out = static_cast<unsigned int>(decompressed.size());
+
+            while (strm.avail_out)
+            {
+                if (!strm.avail_in)
+                {
+                    strm.next_in = reinterpret_cast<char*>(compressed.data());
+                    strm.avail_in = static_cast<unsigned int>(read_some(input, compressed.data(), compressed.size()));
+
+                    if (!strm.avail_in)
+                    {
+                        if (active)
+                        {
+                            MANGO_EXCEPTION("[bzip2] Truncated stream.");
+                        }
+                        break;
+                    }
+                }
+
+                if (!active)
+                {
+                    // concatenated stream
+                    char* next_in = strm.next_in;
+                    unsigned int avail_in = strm.avail_in;
+
+                    BZ2_bzDecompressEnd(&strm);
+                    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK)
+                    {
+                        MANGO_EXCEPTION("[bzip2] decompression failed.");
+                    }
+
+                    strm.next_in = next_in;
+                    strm.avail_in = avail_in;
+                    active = true;
+                }
+
+                int x = BZ2_bzDecompress(&strm);
+                if (x == BZ_STREAM_END)
+                {
+                    active = false;
+                }
+                else if (x != BZ_OK)
+                {
+                    MANGO_EXCEPTION("[bzip2] decompression failed.");
+                }
+            }
+
+            return ConstMemory(decompressed.data(), decompressed.size() - strm.avail_out);
+        }
+    };
+
+#endif // MANGO_ENABLE_LICENSE_ZLIB
+
+} // namespace
+
+    // -----------------------------------------------------------------
+    // CompressStream
+    // -----------------------------------------------------------------
+
+    CompressStream::CompressStream(Stream& output, Compressor::Method method, int level, size_t window)
+    {
+        window = clamp_window(window);
+
+        switch (method)
+        {
+            case Compressor::GZIP:
+                m_handle = new CompressGzip(output, level, window);
+                break;
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::ZSTD:
+                m_handle = new CompressZSTD(output, level, window);
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::BZIP2:
+                m_handle = new CompressBZIP2(output, level, window);
+                break;
+#endif
+            default:
+                m_handle = new CompressChunk(output, method, level, window);
+                break;
+        }
+    }
+
+    CompressStream::~CompressStream()
+    {
+        try
+        {
+            finish();
+        }
+        catch (...)
+        {
+            // the errors are reported by calling finish() explicitly
+        }
+
+        delete m_handle;
+    }
+
+    u64 CompressStream::size() const
+    {
+        return m_handle->offset;
+    }
+
+    u64 CompressStream::offset() const
+    {
+        return m_handle->offset;
+    }
+
+    void CompressStream::seek(u64 distance, SeekMode mode)
+    {
+        MANGO_UNREFERENCED(distance);
+        MANGO_UNREFERENCED(mode);
+        MANGO_EXCEPTION("[CompressStream] Stream is not seekable.");
+    }
+
+    void CompressStream::read(void* dest, size_t size)
+    {
+        MANGO_UNREFERENCED(dest);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[CompressStream] Stream is not readable.");
+    }
+
+    void CompressStream::write(const void* data, size_t size)
+    {
+        CompressStreamHandle& h = *m_handle;
+
+        if (h.finished)
+        {
+            MANGO_EXCEPTION("[CompressStream] Writing to finished stream.");
+        }
+
+        const u8* source = reinterpret_cast<const u8*>(data);
+        const size_t window = h.window.size();
+
+        h.offset += size;
+
+        while (size)
+        {
+            if (!h.used && size >= window)
+            {
+                // full window can be compressed without copying
+                h.encode(ConstMemory(source, window), false);
+                source += window;
+                size -= window;
+                continue;
+            }
+
+            size_t bytes = std::min(size, window - h.used);
+            std::memcpy(h.window.data() + h.used, source, bytes);
+            h.used += bytes;
+            source += bytes;
+            size -= bytes;
+
+            if (h.used == window)
+            {
+                h.encode(h.window, false);
+                h.used = 0;
+            }
+        }
+    }
+
+    void CompressStream::finish()
+    {
+        CompressStreamHandle& h = *m_handle;
+
+        if (!h.finished)
+        {
+            h.finished = true;
+            h.encode(ConstMemory(h.window.data(), h.used), true);
+            h.used = 0;
+        }
+    }
+
+    // -----------------------------------------------------------------
+    // DecompressStream
+    // -----------------------------------------------------------------
+
+    DecompressStream::DecompressStream(Stream& input, Compressor::Method method, size_t window, Format format)
+    {
+        window = clamp_window(window);
+
+        switch (method)
+        {
+            case Compressor::GZIP:
+                m_handle = new DecompressGzip(input, window);
+                break;
+            case Compressor::DEFLATE:
+                if (format == STANDARD)
+                    m_handle = new DecompressDeflate(input, window, false);
+                else
+                    m_handle = new DecompressChunk(input, method);
+                break;
+            case Compressor::ZLIB:
+                if (format == STANDARD || is_zlib_stream(input))
+                    m_handle = new DecompressDeflate(input, window, true);
+                else
+                    m_handle = new DecompressChunk(input, method);
+                break;
+#ifdef MANGO_ENABLE_LICENSE_BSD
+            case Compressor::ZSTD:
+                m_handle = new DecompressZSTD(input, window);
+                break;
+#endif
+#ifdef MANGO_ENABLE_LICENSE_ZLIB
+            case Compressor::BZIP2:
+                m_handle = new DecompressBZIP2(input, window);
+                break;
+#endif
+            default:
+                m_handle = new DecompressChunk(input, method);
+                break;
+        }
+    }
+
+    DecompressStream::~DecompressStream()
+    {
+        delete m_handle;
+    }
+
+    u64 DecompressStream::size() const
+    {
+        return m_handle->decoded;
+    }
+
+    u64 DecompressStream::offset() const
+    {
+        return m_handle->offset;
+    }
+
+    void DecompressStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+            case CURRENT:
+                target = m_handle->offset + distance;
+                break;
+            default:
+                MANGO_EXCEPTION("[DecompressStream] Seeking from the end is not supported.");
+                break;
+        }
+
+        if (target < m_handle->offset)
+        {
+            MANGO_EXCEPTION("[DecompressStream] Seeking backwards is not supported.");
+        }
+
+        u64 skip = target - m_handle->offset;
+
+        while (skip)
+        {
+            ConstMemory memory = acquire();
+            if (!memory.size)
+            {
+                MANGO_EXCEPTION("[DecompressStream] Seeking past end of stream.");
+            }
+
+            if (memory.size > skip)
+            {
+                // give back the part we did not skip over
+                m_handle->position -= size_t(memory.size - skip);
+                m_handle->offset -= memory.size - skip;
+                break;
+            }
+
+            skip -= memory.size;
+        }
+    }
+
+    void DecompressStream::read(void* dest, size_t size)
+    {
+        DecompressStreamHandle& h = *m_handle;
+        u8* output = reinterpret_cast<u8*>(dest);
+
+        while (size)
+        {
+            if (h.position == h.block.size && !h.next())
+            {
+                MANGO_EXCEPTION("[DecompressStream] Reading past end of stream.");
+            }
+
+            size_t bytes = std::min(size, h.block.size - h.position);
+            std::memcpy(output, h.block.address + h.position, bytes);
+            h.position += bytes;
+            h.offset += bytes;
+            output += bytes;
+            size -= bytes;
+        }
+    }
+
+    void DecompressStream::write(const void* data, size_t size)
+    {
+        MANGO_UNREFERENCED(data);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[DecompressStream] Stream is not writable.");
+    }
+
+    ConstMemory DecompressStream::acquire()
+    {
+        DecompressStreamHandle& h = *m_handle;
+
+        if (h.position == h.block.size && !h.next())
+        {
+            return ConstMemory();
+        }
+
+        ConstMemory memory(h.block.address + h.position, h.block.size - h.position);
+        h.position = h.block.size;
+        h.offset += memory.size;
+
+        return memory;
+    }
+
+} // namespace mango
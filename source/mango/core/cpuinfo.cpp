@@ -3,6 +3,10 @@
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
 #include <algorithm>
+#include <thread>
+#include <map>
+#include <string>
+#include <cstdio>
 #include <mango/core/cpuinfo.hpp>
 
 namespace
@@ -281,6 +285,218 @@ namespace
     // cache the flags
     static u64 g_cpu_flags = getCPUFlagsInternal();
 
+    // ----------------------------------------------------------------------------
+    // getCPUTopologyInternal()
+    // ----------------------------------------------------------------------------
+
+    void setDefaultTopology(CPUTopology& topology)
+    {
+        const int count = std::max(int(std::thread::hardware_concurrency()), 1);
+
+        topology.processors.clear();
+
+        for (int i = 0; i < count; ++i)
+        {
+            CPUTopology::Processor processor;
+
+            processor.id = i;
+            processor.core = i;
+            processor.package = 0;
+            processor.node = 0;
+            processor.l2 = i;
+            processor.l3 = 0;
+
+            topology.processors.push_back(processor);
+        }
+    }
+
+#if defined(MANGO_PLATFORM_LINUX)
+
+    bool readSysFile(const std::string& filename, std::string& text)
+    {
+        FILE* file = std::fopen(filename.c_str(), "r");
+        if (!file)
+        {
+            return false;
+        }
+
+        char buffer[1024];
+        size_t bytes = std::fread(buffer, 1, sizeof(buffer) - 1, file);
+        std::fclose(file);
+
+        buffer[bytes] = 0;
+        text = buffer;
+        return true;
+    }
+
+    int readSysInt(const std::string& filename, int value)
+    {
+        std::string text;
+        if (readSysFile(filename, text))
+        {
+            value = std::atoi(text.c_str());
+        }
+        return value;
+    }
+
+    // parse kernel cpulist format, eg. "0-3,8,10-11"
+    std::vector<int> parseCPUList(const std::string& text)
+    {
+        std::vector<int> list;
+
+        const char* p = text.c_str();
+        while (*p >= '0' && *p <= '9')
+        {
+            char* end;
+            int first = int(std::strtol(p, &end, 10));
+            int last = first;
+            p = end;
+
+            if (*p == '-')
+            {
+                last = int(std::strtol(p + 1, &end, 10));
+                p = end;
+            }
+
+            for (int i = first; i <= last; ++i)
+            {
+                list.push_back(i);
+            }
+
+            if (*p == ',')
+            {
+                ++p;
+            }
+        }
+
+        return list;
+    }
+
+    void getCPUTopologyInternal(CPUTopology& topology)
+    {
+        const std::string base = "/sys/devices/system/cpu/";
+
+        std::string text;
+        std::vector<int> online;
+
+        if (readSysFile(base + "online", text))
+        {
+            online = parseCPUList(text);
+        }
+
+        if (online.empty())
+        {
+            setDefaultTopology(topology);
+            return;
+        }
+
+        // processor -> NUMA node
+        std::map<int, int> nodes;
+
+        for (int node = 0; node < 1024; ++node)
+        {
+            std::string nodelist = "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist";
+            if (!readSysFile(nodelist, text))
+            {
+                if (node > 0)
+                    break;
+                continue;
+            }
+
+            for (int cpu : parseCPUList(text))
+            {
+                nodes[cpu] = node;
+            }
+        }
+
+        for (int cpu : online)
+        {
+            const std::string path = base + "cpu" + std::to_string(cpu) + "/";
+
+            CPUTopology::Processor processor;
+
+            processor.id = cpu;
+            processor.core = readSysInt(path + "topology/core_id", cpu);
+            processor.package = readSysInt(path + "topology/physical_package_id", 0);
+            processor.node = nodes.count(cpu) ? nodes[cpu] : 0;
+            processor.l2 = cpu;
+            processor.l3 = processor.package;
+
+            for (int index = 0; index < 8; ++index)
+            {
+                const std::string cache = path + "cache/index" + std::to_string(index) + "/";
+
+                int level = readSysInt(cache + "level", 0);
+                if (!level)
+                    break;
+
+                if (!readSysFile(cache + "shared_cpu_list", text))
+                    continue;
+
+                std::vector<int> shared = parseCPUList(text);
+                if (shared.empty())
+                    continue;
+
+                if (level == 2)
+                    processor.l2 = shared[0];
+                else if (level == 3)
+                    processor.l3 = shared[0];
+            }
+
+            topology.processors.push_back(processor);
+        }
+
+        // core_id is only unique within a package; make it unique system-wide
+        std::map<std::pair<int, int>, int> cores;
+
+        for (auto& processor : topology.processors)
+        {
+            auto key = std::make_pair(processor.package, processor.core);
+            auto it = cores.find(key);
+            if (it == cores.end())
+            {
+                it = cores.emplace(key, int(cores.size())).first;
+            }
+            processor.core = it->second;
+        }
+    }
+
+#else
+
+    // the topology is only parsed on Linux; other platforms report a flat topology
+    void getCPUTopologyInternal(CPUTopology& topology)
+    {
+        setDefaultTopology(topology);
+    }
+
+#endif
+
+    int countUnique(const CPUTopology& topology, int CPUTopology::Processor::*member)
+    {
+        std::vector<int> values;
+
+        for (auto& processor : topology.processors)
+        {
+            values.push_back(processor.*member);
+        }
+
+        std::sort(values.begin(), values.end());
+        return int(std::unique(values.begin(), values.end()) - values.begin());
+    }
+
+    CPUTopology computeCPUTopology()
+    {
+        CPUTopology topology;
+
+        getCPUTopologyInternal(topology);
+
+        topology.cores = countUnique(topology, &CPUTopology::Processor::core);
+        topology.packages = countUnique(topology, &CPUTopology::Processor::package);
+        topology.nodes = countUnique(topology, &CPUTopology::Processor::node);
+
+        return topology;
+    }
+
 } // namespace
 
 namespace mango
@@ -291,4 +507,12 @@ namespace mango
         return g_cpu_flags;
     }
 
+    const CPUTopology& getCPUTopology()
+    {
+        // NOTE: function scope static so that the ThreadPool can query the topology
+        //       during static initialization
+        static CPUTopology topology = computeCPUTopology();
+        return topology;
+    }
+
 } // namespace mango
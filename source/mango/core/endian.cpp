@@ -0,0 +1,178 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <mango/core/endian.hpp>
+
+namespace mango
+{
+
+    // --------------------------------------------------------------
+    // byteswap16_array
+    // --------------------------------------------------------------
+
+    void byteswap16_array(u16* dest, const void* source, size_t count)
+    {
+        const u8* src = reinterpret_cast<const u8*>(source);
+
+#if defined(MANGO_ENABLE_AVX2)
+
+        const __m256i mask = _mm256_setr_epi8(
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+            1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), _mm256_shuffle_epi8(v, mask));
+            src += 32;
+            dest += 16;
+        }
+
+#elif defined(MANGO_ENABLE_SSSE3)
+
+        const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+        for ( ; count >= 16; count -= 16)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 0), _mm_shuffle_epi8(v0, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 8), _mm_shuffle_epi8(v1, mask));
+            src += 32;
+            dest += 16;
+        }
+
+#elif defined(MANGO_ENABLE_NEON)
+
+        for ( ; count >= 16; count -= 16)
+        {
+            uint8x16_t v0 = vld1q_u8(src + 0);
+            uint8x16_t v1 = vld1q_u8(src + 16);
+            vst1q_u8(reinterpret_cast<u8*>(dest + 0), vrev16q_u8(v0));
+            vst1q_u8(reinterpret_cast<u8*>(dest + 8), vrev16q_u8(v1));
+            src += 32;
+            dest += 16;
+        }
+
+#endif
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i] = uload16swap(src + i * 2);
+        }
+    }
+
+    // --------------------------------------------------------------
+    // byteswap32_array
+    // --------------------------------------------------------------
+
+    void byteswap32_array(u32* dest, const void* source, size_t count)
+    {
+        const u8* src = reinterpret_cast<const u8*>(source);
+
+#if defined(MANGO_ENABLE_AVX2)
+
+        const __m256i mask = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+        for ( ; count >= 8; count -= 8)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), _mm256_shuffle_epi8(v, mask));
+            src += 32;
+            dest += 8;
+        }
+
+#elif defined(MANGO_ENABLE_SSSE3)
+
+        const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+        for ( ; count >= 8; count -= 8)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 0), _mm_shuffle_epi8(v0, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 4), _mm_shuffle_epi8(v1, mask));
+            src += 32;
+            dest += 8;
+        }
+
+#elif defined(MANGO_ENABLE_NEON)
+
+        for ( ; count >= 8; count -= 8)
+        {
+            uint8x16_t v0 = vld1q_u8(src + 0);
+            uint8x16_t v1 = vld1q_u8(src + 16);
+            vst1q_u8(reinterpret_cast<u8*>(dest + 0), vrev32q_u8(v0));
+            vst1q_u8(reinterpret_cast<u8*>(dest + 4), vrev32q_u8(v1));
+            src += 32;
+            dest += 8;
+        }
+
+#endif
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i] = uload32swap(src + i * 4);
+        }
+    }
+
+    // --------------------------------------------------------------
+    // byteswap64_array
+    // --------------------------------------------------------------
+
+    void byteswap64_array(u64* dest, const void* source, size_t count)
+    {
+        const u8* src = reinterpret_cast<const u8*>(source);
+
+#if defined(MANGO_ENABLE_AVX2)
+
+        const __m256i mask = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+        for ( ; count >= 4; count -= 4)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest), _mm256_shuffle_epi8(v, mask));
+            src += 32;
+            dest += 4;
+        }
+
+#elif defined(MANGO_ENABLE_SSSE3)
+
+        const __m128i mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+        for ( ; count >= 4; count -= 4)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 0));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 0), _mm_shuffle_epi8(v0, mask));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dest + 2), _mm_shuffle_epi8(v1, mask));
+            src += 32;
+            dest += 4;
+        }
+
+#elif defined(MANGO_ENABLE_NEON)
+
+        for ( ; count >= 4; count -= 4)
+        {
+            uint8x16_t v0 = vld1q_u8(src + 0);
+            uint8x16_t v1 = vld1q_u8(src + 16);
+            vst1q_u8(reinterpret_cast<u8*>(dest + 0), vrev64q_u8(v0));
+            vst1q_u8(reinterpret_cast<u8*>(dest + 2), vrev64q_u8(v1));
+            src += 32;
+            dest += 4;
+        }
+
+#endif
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[i] = uload64swap(src + i * 8);
+        }
+    }
+
+} // namespace mango
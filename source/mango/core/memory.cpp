@@ -5,6 +5,12 @@
 #include <cassert>
 #include <mango/core/bits.hpp>
 #include <mango/core/memory.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/core/thread.hpp>
+
+#if defined(MANGO_PLATFORM_LINUX)
+    #include <sys/mman.h>
+#endif
 
 namespace mango
 {
@@ -32,11 +38,13 @@ namespace mango
 
     Alignment::Alignment()
         : m_alignment(MANGO_DEFAULT_ALIGNMENT)
+        , m_policy(DEFAULT)
     {
     }
 
-    Alignment::Alignment(u32 alignment)
+    Alignment::Alignment(u32 alignment, u32 policy)
         : m_alignment(alignment)
+        , m_policy(policy)
     {
         assert(u32_is_power_of_two(m_alignment));
         assert(m_alignment >= sizeof(void*));
@@ -47,31 +55,132 @@ namespace mango
         return m_alignment;
     }
 
+    u32 Alignment::policy() const
+    {
+        return m_policy;
+    }
+
     // -----------------------------------------------------------------------
     // aligned malloc/free
     // -----------------------------------------------------------------------
 
 #if defined(MANGO_COMPILER_MICROSOFT)
 
-    void* aligned_malloc(size_t bytes, Alignment alignment)
+    static void* allocate_aligned(size_t bytes, Alignment alignment)
     {
         return _aligned_malloc(bytes, alignment);
     }
 
-    void aligned_free(void* aligned)
+    static void free_aligned(void* aligned)
     {
         _aligned_free(aligned);
     }
 
 #elif defined(MANGO_PLATFORM_LINUX)
 
-    void* aligned_malloc(size_t bytes, Alignment alignment)
+    // huge page mappings are released with munmap(); they are recognized in
+    // aligned_free() by the huge page aligned address and looked up by it
+    static const size_t huge_page_size = 2 * 1024 * 1024;
+
+    static std::mutex g_huge_mutex;
+    static std::vector<std::pair<void*, size_t>> g_huge_mappings;
+    static std::atomic<int> g_huge_count { 0 };
+
+    static void* allocate_huge(size_t bytes, Alignment alignment)
     {
+        const size_t size = (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+        void* address = MAP_FAILED;
+
+        if (alignment.policy() & Alignment::HUGE_TLB)
+        {
+            // the kernel aligns hugetlb mappings to the huge page size
+            address = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+
+        if (address == MAP_FAILED)
+        {
+            // map with slack and trim so that the range starts at huge page boundary
+            const size_t align = std::max(size_t(u32(alignment)), huge_page_size);
+            const size_t length = size + align;
+
+            void* base = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED)
+            {
+                return nullptr;
+            }
+
+            uintptr_t start = reinterpret_cast<uintptr_t>(base);
+            uintptr_t aligned = (start + align - 1) & ~uintptr_t(align - 1);
+
+            if (aligned > start)
+            {
+                ::munmap(base, aligned - start);
+            }
+
+            uintptr_t tail = aligned + size;
+            uintptr_t end = start + length;
+            if (end > tail)
+            {
+                ::munmap(reinterpret_cast<void*>(tail), end - tail);
+            }
+
+            address = reinterpret_cast<void*>(aligned);
+
+#ifdef MADV_HUGEPAGE
+            ::madvise(address, size, MADV_HUGEPAGE);
+#endif
+        }
+
+        std::lock_guard<std::mutex> lock(g_huge_mutex);
+        g_huge_mappings.emplace_back(address, size);
+        ++g_huge_count;
+
+        return address;
+    }
+
+    static bool free_huge(void* aligned)
+    {
+        std::lock_guard<std::mutex> lock(g_huge_mutex);
+
+        for (auto it = g_huge_mappings.begin(); it != g_huge_mappings.end(); ++it)
+        {
+            if (it->first == aligned)
+            {
+                ::munmap(it->first, it->second);
+                g_huge_mappings.erase(it);
+                --g_huge_count;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static void* allocate_aligned(size_t bytes, Alignment alignment)
+    {
+        if (alignment.policy() & (Alignment::HUGE_PAGES | Alignment::HUGE_TLB))
+        {
+            void* address = allocate_huge(bytes, alignment);
+            if (address)
+            {
+                return address;
+            }
+        }
+
         return memalign(alignment, bytes);
     }
 
-    void aligned_free(void* aligned)
+    static void free_aligned(void* aligned)
     {
+        const bool candidate = !(reinterpret_cast<uintptr_t>(aligned) & (huge_page_size - 1));
+        if (candidate && g_huge_count.load(std::memory_order_relaxed) > 0)
+        {
+            if (free_huge(aligned))
+            {
+                return;
+            }
+        }
+
         free(aligned);
     }
 
@@ -79,7 +188,7 @@ namespace mango
 
     // generic implementation
 
-    void* aligned_malloc(size_t bytes, Alignment alignment)
+    static void* allocate_aligned(size_t bytes, Alignment alignment)
     {
         const size_t mask = u32(alignment) - 1;
         void* block = std::malloc(bytes + mask + sizeof(void*));
@@ -98,7 +207,7 @@ namespace mango
         return aligned;
     }
 
-    void aligned_free(void* aligned)
+    static void free_aligned(void* aligned)
     {
         if (aligned)
         {
@@ -109,4 +218,169 @@ namespace mango
 
 #endif
 
+    static void prefault(void* address, size_t bytes)
+    {
+        // write one byte per page; the kernel populates the page on the first write
+        // (a read would only map the shared zero page)
+        const size_t page = 4096;
+        const size_t pages = (bytes + page - 1) / page;
+        u8* data = reinterpret_cast<u8*>(address);
+
+        auto touch = [=] (size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                reinterpret_cast<volatile u8*>(data)[i * page] = 0;
+            }
+        };
+
+        // small allocations are not worth distributing to the workers
+        if (pages < 1024)
+        {
+            touch(0, pages);
+            return;
+        }
+
+        parallel_for(0, pages, parallel_grain(pages), touch);
+    }
+
+    void* aligned_malloc(size_t bytes, Alignment alignment)
+    {
+        void* address = allocate_aligned(bytes, alignment);
+
+        if (address && (alignment.policy() & Alignment::PREFAULT))
+        {
+            prefault(address, bytes);
+        }
+
+        return address;
+    }
+
+    void aligned_free(void* aligned)
+    {
+        free_aligned(aligned);
+    }
+
+    // -----------------------------------------------------------------------
+    // Arena
+    // -----------------------------------------------------------------------
+
+    // a reset arena keeps at most this much memory for re-use; every thread has
+    // its own arena so anything larger is returned to the system
+    static const size_t arena_retain_limit = 4 * 1024 * 1024;
+
+    Arena::Arena(size_t block_size)
+        : m_current(0)
+        , m_offset(0)
+        , m_block_size(std::max(block_size, size_t(256)))
+    {
+    }
+
+    Arena::~Arena()
+    {
+        for (auto& block : m_blocks)
+        {
+            aligned_free(block.data);
+        }
+    }
+
+    void* Arena::allocate(size_t bytes, Alignment alignment)
+    {
+        const uintptr_t mask = u32(alignment) - 1;
+
+        for ( ; m_current < m_blocks.size(); ++m_current, m_offset = 0)
+        {
+            Block& block = m_blocks[m_current];
+
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+            size_t offset = size_t(((base + m_offset + mask) & ~mask) - base);
+
+            if (offset + bytes <= block.size)
+            {
+                m_offset = offset + bytes;
+                return block.data + offset;
+            }
+        }
+
+        // out of blocks; grow geometrically so that the number of blocks stays small
+        size_t size = std::max(m_block_size, capacity());
+        size = std::max(size, bytes + size_t(mask));
+
+        u8* data = reinterpret_cast<u8*>(aligned_malloc(size, Alignment(64)));
+        if (!data)
+        {
+            MANGO_EXCEPTION("[Arena] Out of memory.");
+        }
+
+        m_blocks.push_back({ data, size });
+        m_current = m_blocks.size() - 1;
+
+        uintptr_t base = reinterpret_cast<uintptr_t>(data);
+        size_t offset = size_t(((base + mask) & ~mask) - base);
+
+        m_offset = offset + bytes;
+        return data + offset;
+    }
+
+    Arena::Marker Arena::mark() const
+    {
+        return { m_current, m_offset };
+    }
+
+    void Arena::rewind(Marker marker)
+    {
+        m_current = marker.block;
+        m_offset = marker.offset;
+
+        if (!m_current && !m_offset)
+        {
+            // the arena is empty; this is the only time the blocks can be replaced
+            consolidate();
+        }
+    }
+
+    void Arena::reset()
+    {
+        rewind({ 0, 0 });
+    }
+
+    void Arena::consolidate()
+    {
+        const size_t total = capacity();
+        if (m_blocks.size() <= 1 && total <= arena_retain_limit)
+            return;
+
+        for (auto& block : m_blocks)
+        {
+            aligned_free(block.data);
+        }
+
+        m_blocks.clear();
+
+        if (total <= arena_retain_limit)
+        {
+            u8* data = reinterpret_cast<u8*>(aligned_malloc(total, Alignment(64)));
+            if (data)
+            {
+                m_blocks.push_back({ data, total });
+            }
+        }
+    }
+
+    size_t Arena::capacity() const
+    {
+        size_t total = 0;
+        for (auto& block : m_blocks)
+        {
+            total += block.size;
+        }
+        return total;
+    }
+
+    Arena& getThreadArena()
+    {
+        static thread_local Arena arena(256 * 1024);
+        return arena;
+    }
+
 } // namespace mango
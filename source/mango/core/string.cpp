@@ -8,6 +8,7 @@
 #include <cstring>
 #include <mango/core/string.hpp>
 #include <mango/core/bits.hpp>
+#include <mango/simd/simd.hpp>
 
 namespace
 {
@@ -59,23 +60,167 @@ namespace
         }
     };
 
-    template <typename T>
-    inline std::vector<std::string> splitTemplate(const std::string& s, T delimiter)
+    // -----------------------------------------------------------------
+    // vectorized character scanning
+    // -----------------------------------------------------------------
+
+#if defined(MANGO_ENABLE_SIMD)
+
+    using mango::simd::u8x16;
+    using mango::simd::mask8x16;
+
+    // mask of the characters in v which are in the set
+    inline u32 matchMask(u8x16 v, const u8x16* set, size_t count)
     {
-        std::vector<std::string> result;
+        mask8x16 mask = mango::simd::compare_eq(v, set[0]);
+        for (size_t i = 1; i < count; ++i)
+        {
+            mask = mask | mango::simd::compare_eq(v, set[i]);
+        }
+        return mango::simd::get_mask(mask);
+    }
+
+#endif
+
+    inline bool isMember(char c, const char* set, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (c == set[i])
+                return true;
+        }
+        return false;
+    }
+
+    size_t scanFirst(const char* s, size_t size, const char* set, size_t count)
+    {
+        if (!count)
+        {
+            // empty set has no members
+            return mango::StringView::npos;
+        }
+
+        size_t offset = 0;
+
+#if defined(MANGO_ENABLE_SIMD)
+        if (count <= 4)
+        {
+            u8x16 ref[4];
+            for (size_t i = 0; i < count; ++i)
+            {
+                ref[i] = mango::simd::u8x16_set(u8(set[i]));
+            }
+
+            for ( ; offset + 16 <= size; offset += 16)
+            {
+                u8x16 v = mango::simd::u8x16_uload(reinterpret_cast<const u8*>(s + offset));
+                u32 mask = matchMask(v, ref, count);
+                if (mask)
+                {
+                    return offset + mango::u32_tzcnt(mask);
+                }
+            }
+        }
+#endif
+
+        for ( ; offset < size; ++offset)
+        {
+            if (isMember(s[offset], set, count))
+                return offset;
+        }
+
+        return mango::StringView::npos;
+    }
 
-        std::size_t current = 0;
-        std::size_t p = s.find_first_of(delimiter, 0);
+    size_t scanLast(const char* s, size_t size, const char* set, size_t count)
+    {
+        if (!count)
+        {
+            // empty set has no members
+            return mango::StringView::npos;
+        }
 
-        while (p != std::string::npos)
+#if defined(MANGO_ENABLE_SIMD)
+        if (count <= 4)
         {
-            result.emplace_back(s, current, p - current);
-            current = p + 1;
-            p = s.find_first_of(delimiter, current);
+            u8x16 ref[4];
+            for (size_t i = 0; i < count; ++i)
+            {
+                ref[i] = mango::simd::u8x16_set(u8(set[i]));
+            }
+
+            for ( ; size >= 16; size -= 16)
+            {
+                u8x16 v = mango::simd::u8x16_uload(reinterpret_cast<const u8*>(s + size - 16));
+                u32 mask = matchMask(v, ref, count);
+                if (mask)
+                {
+                    return size - 16 + 31 - mango::u32_lzcnt(mask);
+                }
+            }
         }
+#endif
 
-        result.emplace_back(s, current);
+        while (size-- > 0)
+        {
+            if (isMember(s[size], set, count))
+                return size;
+        }
 
+        return mango::StringView::npos;
+    }
+
+    template <bool Upper>
+    void convertCase(char* dest, const char* source, size_t size)
+    {
+        const u8 first = Upper ? 'a' : 'A';
+
+        size_t offset = 0;
+
+#if defined(MANGO_ENABLE_SIMD)
+        // (c - first) <= 25 selects the letters to convert
+        const u8x16 bias = mango::simd::u8x16_set(first);
+        const u8x16 range = mango::simd::u8x16_set(25);
+        const u8x16 bit = mango::simd::u8x16_set(0x20);
+
+        for ( ; offset + 16 <= size; offset += 16)
+        {
+            u8x16 v = mango::simd::u8x16_uload(reinterpret_cast<const u8*>(source + offset));
+            mask8x16 mask = mango::simd::compare_le(mango::simd::sub(v, bias), range);
+            v = mango::simd::select(mask, mango::simd::bitwise_xor(v, bit), v);
+            mango::simd::u8x16_ustore(reinterpret_cast<u8*>(dest + offset), v);
+        }
+#endif
+
+        for ( ; offset < size; ++offset)
+        {
+            u8 c = u8(source[offset]);
+            dest[offset] = char(u8(c - first) <= 25 ? c ^ 0x20 : c);
+        }
+    }
+
+    template <typename T>
+    inline void splitTemplate(std::vector<T>& result, mango::StringView s, const char* set, size_t count)
+    {
+        size_t current = 0;
+
+        for (;;)
+        {
+            size_t p = scanFirst(s.data() + current, s.size() - current, set, count);
+            if (p == mango::StringView::npos)
+                break;
+
+            result.emplace_back(T(s.substr(current, p)));
+            current += p + 1;
+        }
+
+        result.emplace_back(T(s.substr(current)));
+    }
+
+    inline std::vector<std::string> splitString(mango::StringView s, const char* set, size_t count)
+    {
+        std::vector<std::string> result;
+        splitTemplate(result, s, set, count);
         return result;
     }
 
@@ -448,16 +593,21 @@ namespace mango
     // string utilities
     // -----------------------------------------------------------------
 
-    std::string toLower(std::string s)
+    // NOTE: case conversion is for ASCII characters; UTF-8 multibyte sequences
+    //       are not modified.
+
+    std::string toLower(StringView s)
     {
-        std::transform(s.begin(), s.end(), s.begin(), ::tolower);
-        return s;
+        std::string result(s.size(), 0);
+        convertCase<false>(&result[0], s.data(), s.size());
+        return result;
     }
 
-    std::string toUpper(std::string s)
+    std::string toUpper(StringView s)
     {
-        std::transform(s.begin(), s.end(), s.begin(), ::toupper);
-        return s;
+        std::string result(s.size(), 0);
+        convertCase<true>(&result[0], s.data(), s.size());
+        return result;
     }
 
     std::string removePrefix(const std::string& s, const std::string& prefix)
@@ -473,9 +623,28 @@ namespace mango
         return temp;
     }
 
-    bool isPrefix(const std::string& str, const std::string& prefix)
+    bool isPrefix(StringView str, StringView prefix)
     {
-        return str.length() > prefix.length() && !str.find(prefix, 0);
+        const size_t size = prefix.size();
+        if (str.size() <= size)
+        {
+            return false;
+        }
+
+        const u8* a = reinterpret_cast<const u8*>(str.data());
+        const u8* b = reinterpret_cast<const u8*>(prefix.data());
+        size_t offset = 0;
+
+#if defined(MANGO_ENABLE_SIMD)
+        for ( ; offset + 16 <= size; offset += 16)
+        {
+            simd::mask8x16 mask = simd::compare_eq(simd::u8x16_uload(a + offset), simd::u8x16_uload(b + offset));
+            if (simd::get_mask(mask) != 0xffff)
+                return false;
+        }
+#endif
+
+        return !std::memcmp(a + offset, b + offset, size - offset);
     }
 
     void replace(std::string& s, const std::string& from, const std::string& to)
@@ -491,19 +660,36 @@ namespace mango
         }
     }
 
-    std::vector<std::string> split(const std::string& s, char delimiter)
+    std::vector<std::string> split(StringView s, char delimiter)
     {
-        return splitTemplate(s, delimiter);
+        return splitString(s, &delimiter, 1);
     }
 
-    std::vector<std::string> split(const std::string& s, const char* delimiter)
+    std::vector<std::string> split(StringView s, const char* delimiter)
     {
-        return splitTemplate(s, delimiter);
+        return splitString(s, delimiter, std::strlen(delimiter));
     }
 
-    std::vector<std::string> split(const std::string& s, const std::string& delimiter)
+    std::vector<std::string> split(StringView s, const std::string& delimiter)
     {
-        return splitTemplate(s, delimiter);
+        return splitString(s, delimiter.data(), delimiter.length());
+    }
+
+    std::vector<StringView> splitView(StringView s, char delimiter)
+    {
+        std::vector<StringView> result;
+        splitTemplate(result, s, &delimiter, 1);
+        return result;
+    }
+
+    size_t findFirstOf(StringView s, StringView set)
+    {
+        return scanFirst(s.data(), s.size(), set.data(), set.size());
+    }
+
+    size_t findLastOf(StringView s, StringView set)
+    {
+        return scanLast(s.data(), s.size(), set.data(), set.size());
     }
 
     std::string makeString(const char* format, ...)
@@ -523,25 +709,20 @@ namespace mango
     // memchr()
     // ----------------------------------------------------------------------------
 
-#if defined(MANGO_ENABLE_SSE2)
+#if defined(MANGO_ENABLE_SIMD)
 
     const u8* memchr(const u8* p, u8 value, size_t count)
     {
-        __m128i ref = _mm_set1_epi8(value);
-        while (count >= 16)
+        const simd::u8x16 ref = simd::u8x16_set(value);
+
+        for ( ; count >= 16; count -= 16)
         {
-            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(p));
-            u32 mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, ref));
+            simd::u8x16 v = simd::u8x16_uload(p);
+            u32 mask = simd::get_mask(simd::compare_eq(v, ref));
             if (mask)
             {
-                int index = u32_tzcnt(mask);
-                for (int i = index; i < 16; ++i)
-                {
-                    if (p[i] == value)
-                        return p + i;
-                }
+                return p + u32_tzcnt(mask);
             }
-            count -= 16;
             p += 16;
         }
 
@@ -551,15 +732,15 @@ namespace mango
                 return p + i;
         }
 
-        return p;
+        return p + count;
     }
 
 #else
 
     const u8* memchr(const u8* p, u8 value, size_t count)
     {
-        p = reinterpret_cast<const u8 *>(std::memchr(p, value, count));
-        return p ? p : p + count;
+        const u8* s = reinterpret_cast<const u8 *>(std::memchr(p, value, count));
+        return s ? s : p + count;
     }
 
 #endif
@@ -181,6 +181,10 @@ namespace mango
         info << std::endl;
 
         info << "Hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+        const CPUTopology& topology = getCPUTopology();
+        info << "Topology: " << topology.cores << " cores, " << topology.packages << " packages, "
+             << topology.nodes << " NUMA nodes" << std::endl;
         info << "Build: " << __DATE__ << "  " << __TIME__ << std::endl;
 
         return info.str();
@@ -2,15 +2,12 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
-#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <mango/core/bits.hpp>
 #include <mango/core/thread.hpp>
-#include "../../external/concurrentqueue/concurrentqueue.h"
-#include "../../external/concurrentqueue/readerwriterqueue.h"
-
-using std::chrono::high_resolution_clock;
-using std::chrono::duration_cast;
-using std::chrono::microseconds;
-using std::chrono::milliseconds;
+#include <mango/core/cpuinfo.hpp>
 
 // ------------------------------------------------------------
 // thread affinity
@@ -19,33 +16,62 @@ using std::chrono::milliseconds;
 #if defined(MANGO_PLATFORM_LINUX) || defined(MANGO_PLATFORM_BSD)
 
 #include <pthread.h>
+#include <sched.h>
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
         cpu_set_t cpuset;
 
         CPU_ZERO(&cpuset);
-        CPU_SET(processor, &cpuset);
+        for (int processor : processors)
+        {
+            CPU_SET(processor, &cpuset);
+        }
         pthread_setaffinity_np(handle, sizeof(cpu_set_t), &cpuset);
     }
 
-    static void set_current_thread_affinity(int processor)
+    static size_t get_process_concurrency()
     {
-        set_thread_affinity(pthread_self(), processor);
+        // the process can be restricted to a subset of the processors (taskset, cgroups)
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+
+        if (!sched_getaffinity(0, sizeof(cpu_set_t), &cpuset))
+        {
+            int count = CPU_COUNT(&cpuset);
+            if (count > 0)
+            {
+                return size_t(count);
+            }
+        }
+
+        return std::max(std::thread::hardware_concurrency(), 1U);
     }
 
 #elif defined(MANGO_PLATFORM_WINDOWS)
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
-        SetThreadAffinityMask(handle, DWORD_PTR(1) << processor);
+        DWORD_PTR mask = 0;
+        for (int processor : processors)
+        {
+            if (processor < 64)
+            {
+                mask |= DWORD_PTR(1) << processor;
+            }
+        }
+
+        if (mask)
+        {
+            SetThreadAffinityMask(handle, mask);
+        }
     }
 
-    static void set_current_thread_affinity(int processor)
+    static size_t get_process_concurrency()
     {
-        set_thread_affinity(GetCurrentThread(), processor);
+        return std::max(std::thread::hardware_concurrency(), 1U);
     }
 
 #else
@@ -53,15 +79,15 @@ using std::chrono::milliseconds;
     // TODO: iOS, macOS, Android
 
     template <typename H>
-    static void set_thread_affinity(H handle, int processor)
+    static void set_thread_affinity(H handle, const std::vector<int>& processors)
     {
         MANGO_UNREFERENCED(handle);
-        MANGO_UNREFERENCED(processor);
+        MANGO_UNREFERENCED(processors);
     }
 
-    static void set_current_thread_affinity(int processor)
+    static size_t get_process_concurrency()
     {
-        MANGO_UNREFERENCED(processor);
+        return std::max(std::thread::hardware_concurrency(), 1U);
     }
 
 #endif
@@ -95,37 +121,228 @@ namespace mango
     // ------------------------------------------------------------
 
     static const
-    size_t concurrency = std::max(std::thread::hardware_concurrency() - 0, 1U);
+    size_t concurrency = get_process_concurrency();
 
     ThreadPool ThreadPool::m_static_instance(concurrency);
 
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+
+    static inline u64 instrument_time()
+    {
+        auto time = std::chrono::steady_clock::now().time_since_epoch();
+        return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+    }
+
+    struct InstrumentHistogram
+    {
+        std::atomic<u64> bins[32];
+        std::atomic<u64> total_ns { 0 };
+
+        InstrumentHistogram()
+        {
+            for (auto& bin : bins)
+            {
+                bin.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void add(u64 ns)
+        {
+            int bin = ns ? std::min(u64_log2(ns), 31) : 0;
+            bins[bin].fetch_add(1, std::memory_order_relaxed);
+            total_ns.fetch_add(ns, std::memory_order_relaxed);
+        }
+
+        void accumulate(ThreadPoolStatistics::Histogram& histogram) const
+        {
+            for (int i = 0; i < 32; ++i)
+            {
+                u64 count = bins[i].load(std::memory_order_relaxed);
+                histogram.bins[i] += count;
+                histogram.count += count;
+            }
+            histogram.total_ns += total_ns.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct ThreadPool::Counters
+    {
+        u32 name;
+        std::atomic<u64> enqueued { 0 };
+        std::atomic<u64> dequeued { 0 };
+        std::atomic<u64> wait_calls { 0 };
+        std::atomic<u64> wait_ns { 0 };
+        InstrumentHistogram latency;
+        InstrumentHistogram runtime;
+    };
+
+    struct TraceEvent
+    {
+        u64 start;
+        u64 duration;
+        u64 latency;
+        u32 name;
+    };
+
+    struct ThreadPool::WorkerCounters
+    {
+        using CacheLine = u8[64];
+
+        std::atomic<u64> tasks { 0 };
+        std::atomic<u64> busy_ns { 0 };
+        std::atomic<u64> parked_ns { 0 };
+
+        SpinLock lock;
+        std::vector<TraceEvent> events;
+        size_t next = 0;
+        bool wrapped = false;
+
+        CacheLine padding;
+    };
+
+#endif
+
     struct ThreadPool::TaskQueue
     {
-        enum { N = 1 };
-        moodycamel::ConcurrentQueue<ThreadPool::Task> tasks[N];
+        using CacheLine = u8[64];
+
+        // ring buffer which grows when it runs out of capacity; after warm-up
+        // pushing and popping tasks does not allocate memory
+        struct Deque
+        {
+            std::atomic<size_t> size { 0 };
+            SpinLock lock;
+            std::vector<ThreadPool::Task> ring;
+            size_t head = 0;
+            size_t count = 0;
+            CacheLine padding;
+
+            void grow(size_t required)
+            {
+                size_t capacity = std::max(ring.size(), size_t(64));
+                while (capacity < required)
+                {
+                    capacity *= 2;
+                }
+
+                if (capacity == ring.size())
+                    return;
+
+                std::vector<ThreadPool::Task> temp(capacity);
+                const size_t mask = ring.size() - 1;
+
+                for (size_t i = 0; i < count; ++i)
+                {
+                    temp[i] = std::move(ring[(head + i) & mask]);
+                }
+
+                ring.swap(temp);
+                head = 0;
+            }
 
-        moodycamel::ConcurrentQueue<ThreadPool::Task>& get()
+            void push(ThreadPool::Task&& task)
+            {
+                grow(count + 1);
+                ring[(head + count) & (ring.size() - 1)] = std::move(task);
+                ++count;
+            }
+        };
+
+        Deque deques[3];
+
+        void push(int priority, ThreadPool::Task&& task)
+        {
+            Deque& deque = deques[priority];
+            SpinLockGuard guard(deque.lock);
+            deque.push(std::move(task));
+            deque.size.store(deque.count, std::memory_order_release);
+        }
+
+        void push(int priority, Queue* queue, TaskFunction* funcs, size_t count)
+        {
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+            const u64 time = instrument_time();
+#endif
+
+            Deque& deque = deques[priority];
+            SpinLockGuard guard(deque.lock);
+            deque.grow(deque.count + count);
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                ThreadPool::Task task;
+                task.queue = queue;
+                task.func = std::move(funcs[i]);
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+                task.time = time;
+#endif
+                deque.push(std::move(task));
+            }
+
+            deque.size.store(deque.count, std::memory_order_release);
+        }
+
+        // owner: newest task first (LIFO)
+        bool pop(int priority, ThreadPool::Task& task)
+        {
+            Deque& deque = deques[priority];
+            if (!deque.size.load(std::memory_order_acquire))
+                return false;
+
+            SpinLockGuard guard(deque.lock);
+            if (!deque.count)
+                return false;
+
+            --deque.count;
+            task = std::move(deque.ring[(deque.head + deque.count) & (deque.ring.size() - 1)]);
+            deque.size.store(deque.count, std::memory_order_release);
+            return true;
+        }
+
+        // thief: oldest task first (FIFO)
+        bool steal(int priority, ThreadPool::Task& task)
         {
-            thread_local size_t idx = 0;
-            return tasks[idx++ % N];
+            Deque& deque = deques[priority];
+            if (!deque.size.load(std::memory_order_acquire))
+                return false;
+
+            SpinLockGuard guard(deque.lock);
+            if (!deque.count)
+                return false;
+
+            task = std::move(deque.ring[deque.head]);
+            deque.head = (deque.head + 1) & (deque.ring.size() - 1);
+            --deque.count;
+            deque.size.store(deque.count, std::memory_order_release);
+            return true;
         }
     };
 
-    ThreadPool::ThreadPool(size_t size)
+    struct WorkerContext
+    {
+        ThreadPool* pool = nullptr;
+        size_t index = 0;
+    };
+
+    // identifies the pool and deque owned by the current thread
+    static thread_local WorkerContext g_worker;
+
+    ThreadPool::ThreadPool(size_t size, Affinity affinity)
         : m_queues(nullptr)
+        , m_queue_count(std::max(size, size_t(1)))
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        , m_worker_counters(new WorkerCounters[m_queue_count + 1])
+        , m_start_time(instrument_time())
+#endif
         , m_static_queue(this, int(Priority::NORMAL), "static")
+        , m_parallel_queue(this, int(Priority::HIGH), "parallel_for")
         , m_threads(size)
     {
-        m_queues = new TaskQueue[3];
+        m_queues = new TaskQueue[m_queue_count];
 
-        // NOTE: let OS scheduler shuffle tasks as it sees fit
-        //       this gives better performance overall UNTIL we have some practical
-        //       use for the affinity (eg. dependent tasks using same cache)
-        const bool affinity = false;//std::thread::hardware_concurrency() > 1;
-		if (affinity)
-        {
-            set_current_thread_affinity(0);
-        }
+        // NOTE: by default let OS scheduler shuffle tasks as it sees fit; this gives better
+        //       performance overall unless the tasks depend on data in a specific cache or node
+        configure(affinity);
 
         for (size_t i = 0; i < size; ++i)
         {
@@ -135,7 +352,7 @@ namespace mango
             });
 
 #if defined(MANGO_PLATFORM_WINDOWS)
-            if (concurrency > 64)
+            if (concurrency > 64 && affinity == Affinity::NONE)
             {
                 // HACK: work around Windows 64 logical processor per ProcessorGroup limitation
                 GROUP_AFFINITY group{};
@@ -147,16 +364,110 @@ namespace mango
             }
 #endif
 
-			if (affinity)
+            if (!m_processors[i].empty())
+            {
+                set_thread_affinity(get_native_handle(m_threads[i]), m_processors[i]);
+            }
+        }
+    }
+
+    void ThreadPool::configure(Affinity affinity)
+    {
+        const size_t size = m_threads.size();
+
+        m_processors.assign(size, std::vector<int>());
+        m_worker_node.assign(size, -1);
+        m_node_workers.clear();
+
+        if (affinity == Affinity::NONE || !size)
+        {
+            return;
+        }
+
+        // the topology is only parsed when the workers are pinned
+        const CPUTopology& topology = getCPUTopology();
+        if (topology.processors.empty())
+        {
+            return;
+        }
+
+        if (affinity == Affinity::CORE)
+        {
+            // first logical processor of every physical core, then the SMT siblings
+            std::vector<CPUTopology::Processor> order = topology.processors;
+            std::vector<int> sibling(order.size(), 0);
+            std::vector<int> seen(topology.cores, 0);
+
+            for (size_t i = 0; i < order.size(); ++i)
+            {
+                sibling[i] = seen[order[i].core]++;
+            }
+
+            std::vector<size_t> index(order.size());
+            for (size_t i = 0; i < index.size(); ++i)
+            {
+                index[i] = i;
+            }
+
+            std::stable_sort(index.begin(), index.end(), [&] (size_t a, size_t b)
+            {
+                if (sibling[a] != sibling[b])
+                    return sibling[a] < sibling[b];
+                return order[a].node < order[b].node;
+            });
+
+            for (size_t i = 0; i < size; ++i)
+            {
+                const CPUTopology::Processor& processor = order[index[i % index.size()]];
+                m_processors[i].push_back(processor.id);
+                m_worker_node[i] = processor.node;
+            }
+        }
+        else
+        {
+            // L3 cache domains in the order they are found
+            std::vector<int> domains;
+            for (auto& processor : topology.processors)
+            {
+                if (std::find(domains.begin(), domains.end(), processor.l3) == domains.end())
+                {
+                    domains.push_back(processor.l3);
+                }
+            }
+
+            // contiguous blocks of workers share a domain
+            for (size_t i = 0; i < size; ++i)
+            {
+                int domain = domains[(i * domains.size()) / size];
+                for (auto& processor : topology.processors)
+                {
+                    if (processor.l3 == domain)
+                    {
+                        m_processors[i].push_back(processor.id);
+                        m_worker_node[i] = processor.node;
+                    }
+                }
+            }
+        }
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            size_t node = size_t(m_worker_node[i]);
+            if (node >= m_node_workers.size())
             {
-                set_thread_affinity(get_native_handle(m_threads[i]), int(i + 1));
+                m_node_workers.resize(node + 1);
             }
+            m_node_workers[node].push_back(i);
         }
     }
 
     ThreadPool::~ThreadPool()
     {
         m_stop = true;
+
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        ++m_epoch;
+        lock.unlock();
         m_condition.notify_all();
 
         for (auto& thread : m_threads)
@@ -165,6 +476,10 @@ namespace mango
         }
 
         delete[] m_queues;
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        delete[] m_worker_counters;
+#endif
     }
 
     ThreadPool& ThreadPool::getInstance()
@@ -182,85 +497,261 @@ namespace mango
         return int(m_threads.size());
     }
 
+    int ThreadPool::getWorkerNode(size_t worker) const
+    {
+        return worker < m_worker_node.size() ? m_worker_node[worker] : -1;
+    }
+
+    void ThreadPool::setSpinBudget(int rounds)
+    {
+        m_spin_budget = std::max(rounds, 0);
+    }
+
+    int ThreadPool::getSpinBudget() const
+    {
+        return m_spin_budget;
+    }
+
+    u64 ThreadPool::getSpuriousWakeups() const
+    {
+        return m_spurious_wakeups;
+    }
+
     void ThreadPool::thread(size_t threadID)
     {
-        auto time0 = high_resolution_clock::now();
+        g_worker.pool = this;
+        g_worker.index = threadID;
+
+        int spin = 0;
+        bool woken = false;
 
         while (!m_stop.load(std::memory_order_relaxed))
         {
             if (dequeue_and_process())
             {
-                // remember the last time we processed a task
-                time0 = high_resolution_clock::now();
+                spin = 0;
+                woken = false;
+                continue;
             }
-            else
+
+            if (woken)
             {
-                // don't be too eager to sleep
-                auto time1 = high_resolution_clock::now();
-                auto elapsed = duration_cast<milliseconds>(time1 - time0).count();
-                if (elapsed >= microseconds(1200).count())
-                {
-                    // sleep but check what's happening after a while unless signaled
-                    ++m_sleep_count;
-                    std::unique_lock<std::mutex> lock(m_queue_mutex);
-                    m_condition.wait_for(lock, milliseconds(120));
-                    --m_sleep_count;
-                }
-                else
-                {
-                    // no work; yield and try again soon
-                    std::this_thread::yield();
-                }
+                ++m_spurious_wakeups;
+                woken = false;
+            }
+
+            if (spin < m_spin_budget.load(std::memory_order_relaxed))
+            {
+                // no work; yield and try again soon
+                ++spin;
+                std::this_thread::yield();
+                continue;
+            }
+
+            // announce that we are going to sleep before the last check for work;
+            // enqueue() publishes the task before it checks the sleep count
+            ++m_sleep_count;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            u32 epoch = m_epoch.load(std::memory_order_acquire);
+
+            if (dequeue_and_process())
+            {
+                --m_sleep_count;
+                spin = 0;
+                continue;
             }
+
+            park(epoch);
+            --m_sleep_count;
+
+            spin = 0;
+            woken = true;
+        }
+    }
+
+    void ThreadPool::park(u32 epoch)
+    {
+        // sleep until the epoch has been advanced by unpark(); the epoch is
+        // advanced while holding the mutex so the signal cannot be missed
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        const u64 start = instrument_time();
+#endif
+
+        std::unique_lock<std::mutex> lock(m_queue_mutex);
+        while (m_epoch.load(std::memory_order_relaxed) == epoch && !m_stop)
+        {
+            m_condition.wait(lock);
+        }
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        m_worker_counters[g_worker.index].parked_ns.fetch_add(instrument_time() - start, std::memory_order_relaxed);
+#endif
+    }
+
+    void ThreadPool::unpark(size_t count)
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleep_count.load(std::memory_order_relaxed) > 0)
+        {
+            std::unique_lock<std::mutex> lock(m_queue_mutex);
+            m_epoch.fetch_add(1, std::memory_order_relaxed);
+            lock.unlock();
+
+            if (count > 1)
+                m_condition.notify_all();
+            else
+                m_condition.notify_one();
+        }
+    }
+
+    size_t ThreadPool::select(Queue* queue)
+    {
+        const std::vector<size_t>* local = nullptr;
+        if (queue->node >= 0 && size_t(queue->node) < m_node_workers.size())
+        {
+            local = &m_node_workers[queue->node];
+        }
+
+        thread_local size_t counter = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+        size_t index;
+        if (g_worker.pool == this && (!local || m_worker_node[g_worker.index] == queue->node))
+        {
+            // workers keep the tasks they spawn to themselves
+            index = g_worker.index;
+        }
+        else if (local && !local->empty())
+        {
+            // distribute between the workers on the preferred node
+            index = (*local)[counter++ % local->size()];
+        }
+        else
+        {
+            // distribute external submissions between the workers
+            index = counter++ % m_queue_count;
         }
+
+        return index;
     }
 
-    void ThreadPool::enqueue(Queue* queue, std::function<void()>&& func)
+    void ThreadPool::enqueue(Queue* queue, TaskFunction&& func)
     {
         Task task;
         task.queue = queue;
         task.func = std::move(func);
 
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        task.time = instrument_time();
+        queue->counters->enqueued.fetch_add(1, std::memory_order_relaxed);
+#endif
+
         ++queue->task_counter;
-        m_queues[queue->priority].get().enqueue(std::move(task));
+        m_queues[select(queue)].push(queue->priority, std::move(task));
 
-        if (m_sleep_count > 0)
-        {
-            m_condition.notify_one();
-        }
+        unpark();
+    }
+
+    void ThreadPool::enqueue_bulk(Queue* queue, TaskFunction* funcs, size_t count)
+    {
+        if (!count)
+            return;
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        queue->counters->enqueued.fetch_add(count, std::memory_order_relaxed);
+#endif
+
+        // the whole batch goes into one deque; idle workers will steal from it
+        queue->task_counter += int(count);
+        m_queues[select(queue)].push(queue->priority, queue, funcs, count);
+
+        unpark(count);
     }
 
     bool ThreadPool::dequeue_and_process()
     {
+        const bool worker = g_worker.pool == this;
+        const size_t self = worker ? g_worker.index : m_queue_count;
+
+        thread_local size_t victim = 0;
+
         // scan task queues in priority order
-        for (size_t priority = 0; priority < 3; ++priority)
+        for (int priority = 0; priority < 3; ++priority)
         {
             Task task;
-            if (m_queues[priority].get().try_dequeue(task))
+
+            if (worker && m_queues[self].pop(priority, task))
             {
-                Queue* queue = task.queue;
+                process(task);
+                return true;
+            }
 
-                // check if the task is cancelled
-                if (!queue->cancelled)
+            if (worker && m_node_workers.size() > 1)
+            {
+                // steal from workers on the same NUMA node first
+                for (size_t index : m_node_workers[m_worker_node[self]])
                 {
-                    // process task
-                    task.func();
+                    if (index != self && m_queues[index].steal(priority, task))
+                    {
+                        process(task);
+                        return true;
+                    }
                 }
+            }
 
-                --queue->task_counter;
-                return true;
+            for (size_t i = 0; i < m_queue_count; ++i)
+            {
+                size_t index = (victim + i) % m_queue_count;
+                if (index != self && m_queues[index].steal(priority, task))
+                {
+                    // keep stealing from the same victim while it has work
+                    victim = index;
+                    process(task);
+                    return true;
+                }
             }
         }
 
+        ++victim;
         return false;
     }
 
+    void ThreadPool::process(Task& task)
+    {
+        Queue* queue = task.queue;
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        const u64 start = instrument_time();
+#endif
+
+        // check if the task is cancelled
+        if (!queue->cancelled)
+        {
+            // process task
+            task.func();
+        }
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        // the queue can be destroyed as soon as the counter reaches zero
+        record(task, start, instrument_time());
+#endif
+
+        --queue->task_counter;
+    }
+
     void ThreadPool::wait(Queue* queue)
     {
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        const u64 start = instrument_time();
+#endif
+
         while (queue->task_counter > 0)
         {
             dequeue_and_process();
         }
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+        record_wait(queue, start, instrument_time());
+#endif
     }
 
     void ThreadPool::cancel(Queue* queue)
@@ -271,32 +762,305 @@ namespace mango
     }
 
     // ------------------------------------------------------------
-    // ConcurrentQueue
+    // ThreadPool instrumentation
     // ------------------------------------------------------------
 
-    ConcurrentQueue::ConcurrentQueue()
-        : m_pool(ThreadPool::getInstance())
-        , m_queue(&m_pool, int(Priority::NORMAL), "concurrent.default")
+    u64 ThreadPoolStatistics::Histogram::percentile(double p) const
     {
-    }
+        const u64 target = u64(std::ceil(double(count) * std::min(std::max(p, 0.0), 1.0)));
+        u64 sum = 0;
 
-    ConcurrentQueue::ConcurrentQueue(const std::string& name, Priority priority)
-        : m_pool(ThreadPool::getInstance())
-        , m_queue(&m_pool, int(priority), name)
-    {
+        for (int i = 0; i < 32; ++i)
+        {
+            sum += bins[i];
+            if (sum >= target && sum)
+            {
+                return u64(2) << i;
+            }
+        }
+
+        return 0;
     }
 
-    ConcurrentQueue::~ConcurrentQueue()
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+
+    static
+    ThreadPoolStatistics::Queue& find_queue(std::vector<ThreadPoolStatistics::Queue>& queues, const std::string& name, int priority)
     {
-        wait();
+        for (auto& queue : queues)
+        {
+            if (queue.name == name && queue.priority == priority)
+                return queue;
+        }
+
+        queues.emplace_back();
+        queues.back().name = name;
+        queues.back().priority = priority;
+        return queues.back();
     }
 
-    void ConcurrentQueue::steal()
+    template <typename Counters>
+    void accumulate(ThreadPoolStatistics::Queue& stats, const Counters& counters)
     {
-        m_pool.dequeue_and_process();
+        stats.enqueued += counters.enqueued.load(std::memory_order_relaxed);
+        stats.dequeued += counters.dequeued.load(std::memory_order_relaxed);
+        stats.wait_calls += counters.wait_calls.load(std::memory_order_relaxed);
+        stats.wait_ns += counters.wait_ns.load(std::memory_order_relaxed);
+        counters.latency.accumulate(stats.latency);
+        counters.runtime.accumulate(stats.runtime);
     }
 
-    void ConcurrentQueue::cancel()
+    void ThreadPool::attach(Queue* queue)
+    {
+        std::lock_guard<std::mutex> lock(m_instrument_mutex);
+
+        auto it = std::find(m_names.begin(), m_names.end(), queue->name);
+        u32 name = u32(it - m_names.begin());
+        if (it == m_names.end())
+        {
+            m_names.push_back(queue->name);
+        }
+
+        queue->counters = new Counters();
+        queue->counters->name = name;
+        m_attached.push_back(queue);
+    }
+
+    void ThreadPool::detach(Queue* queue)
+    {
+        std::lock_guard<std::mutex> lock(m_instrument_mutex);
+
+        // keep the counters of destroyed queues in the statistics
+        accumulate(find_queue(m_retired, queue->name, queue->priority), *queue->counters);
+
+        m_attached.erase(std::find(m_attached.begin(), m_attached.end(), queue));
+        delete queue->counters;
+        queue->counters = nullptr;
+    }
+
+    void ThreadPool::record(const Task& task, u64 start, u64 end)
+    {
+        Counters& counters = *task.queue->counters;
+        counters.dequeued.fetch_add(1, std::memory_order_relaxed);
+        counters.latency.add(start - task.time);
+        counters.runtime.add(end - start);
+
+        const size_t index = g_worker.pool == this ? g_worker.index : m_queue_count;
+        WorkerCounters& worker = m_worker_counters[index];
+        worker.tasks.fetch_add(1, std::memory_order_relaxed);
+        worker.busy_ns.fetch_add(end - start, std::memory_order_relaxed);
+
+        if (m_trace.load(std::memory_order_relaxed))
+        {
+            SpinLockGuard guard(worker.lock);
+            if (!worker.events.empty())
+            {
+                worker.events[worker.next] = { start, end - start, start - task.time, counters.name };
+                if (++worker.next == worker.events.size())
+                {
+                    worker.next = 0;
+                    worker.wrapped = true;
+                }
+            }
+        }
+    }
+
+    void ThreadPool::record_wait(Queue* queue, u64 start, u64 end)
+    {
+        queue->counters->wait_calls.fetch_add(1, std::memory_order_relaxed);
+        queue->counters->wait_ns.fetch_add(end - start, std::memory_order_relaxed);
+    }
+
+    ThreadPoolStatistics ThreadPool::getStatistics() const
+    {
+        ThreadPoolStatistics stats;
+        stats.elapsed_ns = instrument_time() - m_start_time;
+
+        std::lock_guard<std::mutex> lock(m_instrument_mutex);
+
+        stats.queues = m_retired;
+        for (Queue* queue : m_attached)
+        {
+            accumulate(find_queue(stats.queues, queue->name, queue->priority), *queue->counters);
+        }
+
+        auto convert = [&] (const WorkerCounters& counters)
+        {
+            ThreadPoolStatistics::Worker worker;
+            worker.tasks = counters.tasks.load(std::memory_order_relaxed);
+            worker.busy_ns = counters.busy_ns.load(std::memory_order_relaxed);
+            worker.parked_ns = counters.parked_ns.load(std::memory_order_relaxed);
+            worker.idle_ns = stats.elapsed_ns > worker.busy_ns ? stats.elapsed_ns - worker.busy_ns : 0;
+            return worker;
+        };
+
+        for (size_t i = 0; i < m_threads.size(); ++i)
+        {
+            stats.workers.push_back(convert(m_worker_counters[i]));
+        }
+
+        stats.external = convert(m_worker_counters[m_queue_count]);
+        stats.external.idle_ns = 0;
+
+        return stats;
+    }
+
+    void ThreadPool::setTrace(bool enable, size_t capacity)
+    {
+        m_trace = false;
+
+        for (size_t i = 0; i <= m_queue_count; ++i)
+        {
+            WorkerCounters& worker = m_worker_counters[i];
+            SpinLockGuard guard(worker.lock);
+
+            if (enable)
+            {
+                worker.events.resize(std::max(capacity, size_t(1)));
+            }
+
+            worker.next = 0;
+            worker.wrapped = false;
+        }
+
+        m_trace = enable;
+    }
+
+    static
+    void append_json_string(std::string& s, const std::string& text)
+    {
+        s += '"';
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                s += '\\';
+                s += c;
+            }
+            else if (u8(c) < 0x20)
+            {
+                s += ' ';
+            }
+            else
+            {
+                s += c;
+            }
+        }
+        s += '"';
+    }
+
+    std::string ThreadPool::getChromeTrace() const
+    {
+        std::vector<std::string> names;
+        {
+            std::lock_guard<std::mutex> lock(m_instrument_mutex);
+            names = m_names;
+        }
+
+        std::string s = "{\"traceEvents\":[";
+        bool first = true;
+        char buffer[256];
+
+        for (size_t i = 0; i <= m_queue_count; ++i)
+        {
+            WorkerCounters& worker = m_worker_counters[i];
+            SpinLockGuard guard(worker.lock);
+
+            if (!worker.next && !worker.wrapped)
+                continue;
+
+            std::snprintf(buffer, sizeof(buffer), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",", int(i));
+            s += buffer;
+            append_json_string(s, i < m_queue_count ? "worker " + std::to_string(i) : std::string("external"));
+            s += "}}";
+            first = false;
+
+            // oldest event first
+            const size_t size = worker.events.size();
+            const size_t count = worker.wrapped ? size : worker.next;
+            const size_t begin = worker.wrapped ? worker.next : 0;
+
+            for (size_t j = 0; j < count; ++j)
+            {
+                const TraceEvent& event = worker.events[(begin + j) % size];
+                const u64 start = event.start > m_start_time ? event.start - m_start_time : 0;
+
+                s += ",\n{\"name\":";
+                append_json_string(s, event.name < names.size() ? names[event.name] : std::string("unknown"));
+                std::snprintf(buffer, sizeof(buffer), ",\"cat\":\"task\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"wait_us\":%.3f}}",
+                    int(i), double(start) / 1000.0, double(event.duration) / 1000.0, double(event.latency) / 1000.0);
+                s += buffer;
+            }
+        }
+
+        s += "\n]}\n";
+        return s;
+    }
+
+#else
+
+    void ThreadPool::attach(Queue* queue)
+    {
+        MANGO_UNREFERENCED(queue);
+    }
+
+    void ThreadPool::detach(Queue* queue)
+    {
+        MANGO_UNREFERENCED(queue);
+    }
+
+    ThreadPoolStatistics ThreadPool::getStatistics() const
+    {
+        return ThreadPoolStatistics();
+    }
+
+    void ThreadPool::setTrace(bool enable, size_t capacity)
+    {
+        MANGO_UNREFERENCED(enable);
+        MANGO_UNREFERENCED(capacity);
+    }
+
+    std::string ThreadPool::getChromeTrace() const
+    {
+        return "{\"traceEvents\":[]}\n";
+    }
+
+#endif // MANGO_ENABLE_THREAD_INSTRUMENTATION
+
+    // ------------------------------------------------------------
+    // ConcurrentQueue
+    // ------------------------------------------------------------
+
+    ConcurrentQueue::ConcurrentQueue()
+        : m_pool(ThreadPool::getInstance())
+        , m_queue(&m_pool, int(Priority::NORMAL), "concurrent.default")
+    {
+    }
+
+    ConcurrentQueue::ConcurrentQueue(const std::string& name, Priority priority)
+        : m_pool(ThreadPool::getInstance())
+        , m_queue(&m_pool, int(priority), name)
+    {
+    }
+
+    ConcurrentQueue::ConcurrentQueue(ThreadPool& pool, const std::string& name, Priority priority, int node)
+        : m_pool(pool)
+        , m_queue(&m_pool, int(priority), name, node)
+    {
+    }
+
+    ConcurrentQueue::~ConcurrentQueue()
+    {
+        wait();
+    }
+
+    void ConcurrentQueue::steal()
+    {
+        m_pool.dequeue_and_process();
+    }
+
+    void ConcurrentQueue::cancel()
     {
         m_pool.cancel(&m_queue);
     }
@@ -306,131 +1070,365 @@ namespace mango
         m_pool.wait(&m_queue);
     }
 
+    // ------------------------------------------------------------
+    // TaskGraph
+    // ------------------------------------------------------------
+
+    TaskGraph::TaskGraph()
+        : m_pool(ThreadPool::getInstance())
+        , m_queue(&m_pool, int(Priority::NORMAL), "graph.default")
+    {
+    }
+
+    TaskGraph::TaskGraph(const std::string& name, Priority priority)
+        : m_pool(ThreadPool::getInstance())
+        , m_queue(&m_pool, int(priority), name)
+    {
+    }
+
+    TaskGraph::~TaskGraph()
+    {
+        wait();
+    }
+
+    void TaskGraph::precede(Node* before, Node* after)
+    {
+        before->successors.push_back(after);
+        ++after->predecessors;
+    }
+
+    void TaskGraph::release(Node* node)
+    {
+        m_pool.enqueue(&m_queue, [this, node]
+        {
+            node->func();
+
+            // the successors are enqueued before this task is retired from the queue
+            // so the queue cannot be observed as drained while the graph is running
+            for (Node* successor : node->successors)
+            {
+                if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    release(successor);
+                }
+            }
+        });
+    }
+
+    void TaskGraph::submit()
+    {
+        // the counters must be armed for all nodes before any of them is released
+        for (auto& node : m_nodes)
+        {
+            node->pending.store(node->predecessors, std::memory_order_relaxed);
+        }
+
+        for (auto& node : m_nodes)
+        {
+            if (!node->predecessors)
+            {
+                release(node.get());
+            }
+        }
+    }
+
+    void TaskGraph::cancel()
+    {
+        // cancelled nodes will not release their successors
+        m_pool.cancel(&m_queue);
+    }
+
+    void TaskGraph::wait()
+    {
+        m_pool.wait(&m_queue);
+    }
+
     // ------------------------------------------------------------
     // SerialQueue
     // ------------------------------------------------------------
 
     SerialQueue::SerialQueue()
-        : m_name("serial.default")
+        : SerialQueue("serial.default")
     {
-        m_thread = std::thread([this] {
-            thread();
-        });
     }
 
-    SerialQueue::SerialQueue(const std::string& name)
+    SerialQueue::SerialQueue(const std::string& name, Executor executor)
         : m_name(name)
+        , m_executor(executor)
+        , m_pool(ThreadPool::getInstance())
+        , m_queue(&m_pool, int(Priority::NORMAL), name)
+        , m_head(new Node())
+        , m_tail(m_head)
+    {
+        if (m_executor == Executor::THREAD)
+        {
+            m_thread = std::thread([this] {
+                thread();
+            });
+        }
+    }
+
+    SerialQueue::SerialQueue(ThreadPool& pool, const std::string& name)
+        : m_name(name)
+        , m_executor(Executor::POOL)
+        , m_pool(pool)
+        , m_queue(&m_pool, int(Priority::NORMAL), name)
+        , m_head(new Node())
+        , m_tail(m_head)
     {
-        m_thread = std::thread([this] {
-            thread();
-        });
     }
 
     SerialQueue::~SerialQueue()
     {
         wait();
 
-        std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
-        m_stop = true;
-        queue_lock.unlock();
+        if (m_executor == Executor::THREAD)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_stop = true;
+            lock.unlock();
 
-        m_task_condition.notify_one();
-        m_thread.join();
+            m_task_condition.notify_one();
+            m_thread.join();
+        }
+
+        delete m_head;
     }
 
-    void SerialQueue::thread()
+    void SerialQueue::push(TaskFunction&& func)
     {
-        while (!m_stop.load(std::memory_order_relaxed))
+        Node* node = new Node();
+        node->sequence = m_sequence.fetch_add(1, std::memory_order_relaxed) + 1;
+        node->func = std::move(func);
+
+        // link the node to the end of the list
+        Node* prev = m_tail.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+
+        if (m_task_counter.fetch_add(1, std::memory_order_acq_rel) == 0)
+        {
+            // the queue was idle; start executing it
+            schedule();
+        }
+    }
+
+    void SerialQueue::schedule()
+    {
+        if (m_executor == Executor::THREAD)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            lock.unlock();
+            m_task_condition.notify_one();
+        }
+        else
+        {
+            m_pool.enqueue(&m_queue, TaskFunction([this]
+            {
+                // execute a bounded batch so that the queue cannot monopolize a worker
+                if (drain(64))
+                {
+                    schedule();
+                }
+            }));
+        }
+    }
+
+    bool SerialQueue::drain(size_t limit)
+    {
+        // only one thread at a time is executing here; the producer which moved the
+        // task counter from zero handed the ownership of the list head to us
+        for (size_t i = 0; i < limit; ++i)
         {
-            std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
-            if (m_task_counter > 0)
+            Node* next = m_head->next.load(std::memory_order_acquire);
+            while (!next)
             {
-                auto task = std::move(m_task_queue.front());
-                m_task_queue.pop_front();
-                queue_lock.unlock();
+                // the producer has claimed the tail but not linked the node yet
+                std::this_thread::yield();
+                next = m_head->next.load(std::memory_order_acquire);
+            }
 
-                task();
+            TaskFunction func = std::move(next->func);
+            const u64 sequence = next->sequence;
 
-                std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-                --m_task_counter;
+            delete m_head;
+            m_head = next;
+
+            if (sequence > m_cancelled.load(std::memory_order_relaxed))
+            {
+                func();
             }
-            else
+
+            if (m_task_counter.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                if (m_executor == Executor::THREAD)
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    lock.unlock();
+                    m_wait_condition.notify_all();
+                }
+
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void SerialQueue::thread()
+    {
+        for (;;)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_condition.wait(lock, [this] { return m_stop || m_task_counter > 0; });
+            lock.unlock();
+
+            if (m_task_counter == 0)
+            {
+                // stop is only requested after the queue has been drained
+                break;
+            }
+
+            while (drain(~size_t(0)))
             {
-                m_wait_condition.notify_all();
-                m_task_condition.wait(queue_lock, [this] { return m_stop || m_task_counter; });
             }
         }
     }
 
     void SerialQueue::cancel()
     {
-        std::unique_lock<std::mutex> queue_lock(m_queue_mutex);
-        m_task_counter -= u32(m_task_queue.size());
-        m_task_queue.clear();
+        // tasks submitted so far are skipped unless they have already started
+        m_cancelled.store(m_sequence.load(std::memory_order_relaxed), std::memory_order_relaxed);
     }
 
     void SerialQueue::wait()
     {
-        std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-        m_wait_condition.wait(wait_lock, [this] { return !m_task_counter.load(std::memory_order_relaxed); });
+        if (m_executor == Executor::THREAD)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wait_condition.wait(lock, [this] { return !m_task_counter.load(std::memory_order_relaxed); });
+        }
+        else
+        {
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+            const u64 start = instrument_time();
+#endif
+
+            // cooperative; the queue may be waiting for a worker to pick it up
+            while (m_task_counter.load(std::memory_order_acquire) > 0)
+            {
+                m_pool.dequeue_and_process();
+            }
+
+            // the last task in the pool may still be returning
+            while (m_queue.task_counter > 0)
+            {
+                m_pool.dequeue_and_process();
+            }
+
+#ifdef MANGO_ENABLE_THREAD_INSTRUMENTATION
+            m_pool.record_wait(&m_queue, start, instrument_time());
+#endif
+        }
     }
 
     // ------------------------------------------------------------
     // TicketQueue::Ticket
     // ------------------------------------------------------------
 
-    TicketQueue::Ticket::Ticket()
-        : task(std::make_shared<Task>())
+    TicketQueue::Ticket::Ticket(TicketQueue* queue, Slot* slot, u64 sequence)
+        : queue(queue)
+        , slot(slot)
+        , sequence(sequence)
     {
     }
 
     TicketQueue::Ticket::~Ticket()
     {
-        if (!--task->count)
+        release();
+    }
+
+    TicketQueue::Ticket::Ticket(const Ticket& ticket)
+        : queue(ticket.queue)
+        , slot(ticket.slot)
+        , sequence(ticket.sequence)
+    {
+        if (queue)
         {
-            if (!task->func)
-            {
-                task->promise.set_value();
-            }
+            slot->count.fetch_add(1, std::memory_order_relaxed);
         }
     }
 
-    TicketQueue::Ticket::Ticket(const Ticket& ticket)
+    TicketQueue::Ticket::Ticket(Ticket&& ticket) noexcept
+        : queue(ticket.queue)
+        , slot(ticket.slot)
+        , sequence(ticket.sequence)
     {
-        task = ticket.task;
-        task->count++;
+        ticket.queue = nullptr;
     }
 
     const TicketQueue::Ticket& TicketQueue::Ticket::operator = (const Ticket& ticket)
     {
-        task = ticket.task;
-        task->count++;
+        if (this != &ticket)
+        {
+            release();
+            queue = ticket.queue;
+            slot = ticket.slot;
+            sequence = ticket.sequence;
+            if (queue)
+            {
+                slot->count.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        return *this;
+    }
+
+    const TicketQueue::Ticket& TicketQueue::Ticket::operator = (Ticket&& ticket) noexcept
+    {
+        if (this != &ticket)
+        {
+            release();
+            queue = ticket.queue;
+            slot = ticket.slot;
+            sequence = ticket.sequence;
+            ticket.queue = nullptr;
+        }
         return *this;
     }
 
+    void TicketQueue::Ticket::release()
+    {
+        if (queue)
+        {
+            if (slot->count.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                // the last reference was dropped without consuming the ticket;
+                // it is executed as an empty task so that the tickets after it can proceed
+                if (!slot->ready.load(std::memory_order_acquire))
+                {
+                    queue->ready(slot, sequence);
+                }
+
+                queue->recycle(slot);
+            }
+            queue = nullptr;
+        }
+    }
+
     // ------------------------------------------------------------
     // TicketQueue
     // ------------------------------------------------------------
 
-    struct TicketQueue::TaskQueue
+    TicketQueue::TicketQueue(size_t capacity)
+        : m_capacity(std::max(capacity, size_t(2)))
     {
-        using Task = TicketQueue::SharedTask;
-        moodycamel::ReaderWriterQueue<Task> tasks;
-    };
+        Segment* segment = create_segment();
+        m_acquire_segment.store(segment, std::memory_order_relaxed);
+        m_consume_segment = segment;
 
-    TicketQueue::TicketQueue()
-        : m_queue(nullptr)
-    {
-        m_queue = new TaskQueue();
         m_thread = std::thread([this]
         {
-            while (!m_stop.load(std::memory_order_relaxed))
+            while (dequeue_and_process())
             {
-                if (!dequeue_and_process())
-                {
-                    std::unique_lock<std::mutex> lock(m_consume_mutex);
-                    m_consume_condition.wait(lock, [this] { return m_stop || m_queue->tasks.peek(); });
-                }
             }
         });
     }
@@ -439,56 +1437,295 @@ namespace mango
     {
         wait();
 
-        std::unique_lock<std::mutex> lock(m_consume_mutex);
+        std::unique_lock<std::mutex> lock(m_mutex);
         m_stop = true;
         lock.unlock();
         m_consume_condition.notify_one();
 
         m_thread.join();
-        delete m_queue;
+
+        // tickets can outlive the wait() when a task is destroyed after it has
+        // consumed it's ticket; wait until every slot has been released
+        while (m_outstanding.load(std::memory_order_acquire))
+        {
+            std::this_thread::yield();
+        }
+
+        for (Segment* segment : m_segments)
+        {
+            delete[] segment->slots;
+            delete segment;
+        }
+
+        for (Segment* segment : m_free_segments)
+        {
+            delete[] segment->slots;
+            delete segment;
+        }
     }
 
-    bool TicketQueue::dequeue_and_process()
+    TicketQueue::Segment* TicketQueue::create_segment()
+    {
+        // called with the segment mutex locked (or from the constructor)
+        Segment* segment;
+
+        if (m_free_segments.empty())
+        {
+            segment = new Segment;
+            segment->slots = new Slot[m_capacity];
+
+            for (size_t i = 0; i < m_capacity; ++i)
+            {
+                segment->slots[i].segment = segment;
+            }
+        }
+        else
+        {
+            segment = m_free_segments.back();
+            m_free_segments.pop_back();
+        }
+
+        segment->next.store(nullptr, std::memory_order_relaxed);
+        segment->owners.store(m_capacity + 1, std::memory_order_relaxed);
+
+        // the segment is published with the base; a stale acquirer which reads
+        // the new base sees the initialized segment
+        segment->base.store(m_next_base, std::memory_order_release);
+        m_next_base += m_capacity;
+
+        if (!m_segments.empty())
+        {
+            m_segments.back()->next.store(segment, std::memory_order_release);
+        }
+
+        m_segments.push_back(segment);
+        return segment;
+    }
+
+    TicketQueue::Segment* TicketQueue::get_segment(u64 sequence)
+    {
+        std::lock_guard<std::mutex> lock(m_segment_mutex);
+
+        // the segment of an unacquired sequence is live or has not been created yet
+        for (Segment* segment : m_segments)
+        {
+            const u64 base = segment->base.load(std::memory_order_relaxed);
+            if (sequence >= base && sequence < base + m_capacity)
+            {
+                return segment;
+            }
+        }
+
+        Segment* segment;
+
+        do
+        {
+            segment = create_segment();
+        } while (sequence >= segment->base.load(std::memory_order_relaxed) + m_capacity);
+
+        m_acquire_segment.store(segment, std::memory_order_release);
+        return segment;
+    }
+
+    void TicketQueue::release_segment(Segment* segment)
+    {
+        if (segment->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(m_segment_mutex);
+
+            m_segments.erase(std::find(m_segments.begin(), m_segments.end(), segment));
+
+            for (size_t i = 0; i < m_capacity; ++i)
+            {
+                segment->slots[i].ready.store(false, std::memory_order_relaxed);
+            }
+
+            m_free_segments.push_back(segment);
+        }
+    }
+
+    TicketQueue::Slot* TicketQueue::consume_slot(u64 sequence)
+    {
+        // only the consumer thread moves the consume segment; the consumer holds
+        // a reference to it's segment until the next segment has been linked
+        Segment* segment = m_consume_segment;
+        u64 index = sequence - segment->base.load(std::memory_order_relaxed);
+
+        if (index == m_capacity)
+        {
+            Segment* next = segment->next.load(std::memory_order_acquire);
+            if (!next)
+            {
+                // the ticket has not been acquired yet
+                return nullptr;
+            }
+
+            m_consume_segment = next;
+            release_segment(segment);
+
+            segment = next;
+            index = 0;
+        }
+
+        return segment->slots + index;
+    }
+
+    void TicketQueue::ready(Slot* slot, u64 sequence)
     {
-        bool processed = false;
+        slot->ready.store(true, std::memory_order_release);
+
+        // only wake up the consumer when it is sleeping on this ticket
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleeping.load(std::memory_order_relaxed) &&
+            m_consume_cursor.load(std::memory_order_relaxed) == sequence)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            lock.unlock();
+            m_consume_condition.notify_one();
+        }
+    }
 
-        SharedTask task;
-        if (m_queue->tasks.try_dequeue(task))
+    void TicketQueue::recycle(Slot* slot)
+    {
+        if (slot->owners.fetch_sub(1, std::memory_order_acq_rel) == 1)
         {
-            std::future<void> future = task->promise.get_future();
-            future.wait();
+            release_segment(slot->segment);
+            m_outstanding.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    bool TicketQueue::dequeue_and_process()
+    {
+        // only the consumer thread advances the consume cursor
+        const u64 sequence = m_consume_cursor.load(std::memory_order_relaxed);
+        Slot* slot = nullptr;
+
+        auto is_ready = [&] {
+            if (!slot)
+            {
+                slot = consume_slot(sequence);
+            }
+            return slot && slot->ready.load(std::memory_order_acquire);
+        };
 
-            if (task->func)
+        if (!is_ready())
+        {
+            for (int i = 0; i < 64 && !is_ready(); ++i)
             {
-                task->func();
+                std::this_thread::yield();
             }
 
-            std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-            if (!--m_ticket_counter)
+            if (!is_ready())
             {
-                m_wait_condition.notify_one();
+                m_sleeping.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_consume_condition.wait(lock, [&] { return m_stop || is_ready(); });
+                lock.unlock();
+
+                m_sleeping.store(false, std::memory_order_relaxed);
+
+                if (!is_ready())
+                {
+                    // stop is only requested after all tickets have been executed
+                    return false;
+                }
             }
+        }
+
+        if (slot->func)
+        {
+            slot->func();
+            slot->func.reset();
+        }
 
-            processed = true;
+        m_consume_cursor.store(sequence + 1, std::memory_order_release);
+        recycle(slot);
+
+        if (sequence + 1 == m_acquire_cursor.load(std::memory_order_acquire))
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            lock.unlock();
+            m_wait_condition.notify_all();
         }
 
-        return processed;
+        return true;
     }
 
     TicketQueue::Ticket TicketQueue::acquire()
     {
-        std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-        ++m_ticket_counter;
-        Ticket ticket;
-        m_queue->tasks.enqueue(ticket.task);
-        m_consume_condition.notify_one();
-        return ticket;
+        const u64 sequence = m_acquire_cursor.fetch_add(1, std::memory_order_acq_rel);
+
+        // The segment of the sequence cannot be recycled before the ticket is released
+        // so reading the base of a (possibly recycled) segment is safe; the segment
+        // is the right one when the sequence is in it's range.
+        Segment* segment = m_acquire_segment.load(std::memory_order_acquire);
+        u64 base = segment->base.load(std::memory_order_acquire);
+
+        if (sequence < base || sequence >= base + m_capacity)
+        {
+            // the queue grows instead of waiting for the consumer
+            segment = get_segment(sequence);
+            base = segment->base.load(std::memory_order_relaxed);
+        }
+
+        Slot* slot = segment->slots + (sequence - base);
+        slot->count.store(1, std::memory_order_relaxed);
+        slot->owners.store(2, std::memory_order_relaxed);
+        m_outstanding.fetch_add(1, std::memory_order_relaxed);
+
+        return Ticket(this, slot, sequence);
     }
 
     void TicketQueue::wait()
     {
-        std::unique_lock<std::mutex> wait_lock(m_wait_mutex);
-        m_wait_condition.wait(wait_lock, [this] { return !m_ticket_counter.load(std::memory_order_relaxed); });
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wait_condition.wait(lock, [this] {
+            return m_consume_cursor.load(std::memory_order_acquire) ==
+                   m_acquire_cursor.load(std::memory_order_acquire);
+        });
+    }
+
+    // ------------------------------------------------------------
+    // parallel_for
+    // ------------------------------------------------------------
+
+    // target duration of a single task; long enough to amortize the scheduling
+    // overhead, short enough for the workers to balance the load
+    static const u64 parallel_task_ns = 50000;
+
+    size_t parallel_grain(size_t count)
+    {
+        const size_t threads = size_t(ThreadPool::getInstanceSize());
+        if (threads <= 1)
+        {
+            return std::max(count, size_t(1));
+        }
+
+        // small pools need finer granularity so that every worker has enough work
+        const size_t tasks = threads < 16 ? threads * 4 : threads * 2;
+        return std::max((count + tasks - 1) / tasks, size_t(1));
+    }
+
+    size_t parallel_grain(size_t count, u64 probe_ns, size_t probe_count)
+    {
+        const size_t balanced = parallel_grain(count);
+        if (!probe_count)
+        {
+            return balanced;
+        }
+
+        const double cost = double(std::max(probe_ns, u64(1))) / double(probe_count);
+
+        // not worth splitting; the whole range completes in about one task
+        if (cost * double(count) < double(parallel_task_ns * 2))
+        {
+            return std::max(count, size_t(1));
+        }
+
+        const size_t grain = size_t(double(parallel_task_ns) / cost);
+        return std::max(std::min(grain, balanced), size_t(1));
     }
 
 } // namespace mango
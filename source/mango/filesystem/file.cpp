@@ -35,7 +35,7 @@ namespace filesystem {
         if (mapper)
         {
             VirtualMemory* vmemory = mapper->mmap(path_mapper->basepath() + m_filename);
-            m_memory = UniqueObject<VirtualMemory>(vmemory);
+            m_memory = std::shared_ptr<VirtualMemory>(vmemory);
         }
     }
 
@@ -61,7 +61,7 @@ namespace filesystem {
         if (mapper)
         {
             VirtualMemory* vmemory = mapper->mmap(path_mapper->basepath() + m_filename);
-            m_memory = UniqueObject<VirtualMemory>(vmemory);
+            m_memory = std::shared_ptr<VirtualMemory>(vmemory);
         }
     }
 
@@ -87,7 +87,7 @@ namespace filesystem {
         if (mapper)
         {
             VirtualMemory* vmemory = mapper->mmap(m_filename);
-            m_memory = UniqueObject<VirtualMemory>(vmemory);
+            m_memory = std::shared_ptr<VirtualMemory>(vmemory);
         }
     }
 
@@ -115,6 +115,22 @@ namespace filesystem {
         return getMemory();
     }
 
+    File::operator MemoryView () const
+    {
+        struct FileOwner
+        {
+            // the memory must be released before the mappers in the path
+            std::shared_ptr<Path> path;
+            std::shared_ptr<VirtualMemory> memory;
+        };
+
+        std::shared_ptr<FileOwner> owner = std::make_shared<FileOwner>();
+        owner->path = m_path;
+        owner->memory = m_memory;
+
+        return MemoryView(getMemory(), owner);
+    }
+
 	File::operator const u8* () const
 	{
         return getMemory().address;
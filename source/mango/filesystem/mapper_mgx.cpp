@@ -16,12 +16,30 @@ namespace
 
     constexpr u64 mgx_header_size = 24;
 
+    // Version 2 containers can store a dictionary which is shared by the blocks;
+    // the dictionary is stored in a block which is referenced from the block table.
+    // Blocks compressed with the dictionary have the dictionary flag in the method.
+
+    constexpr u32 mgx_method_mask = 0xff;
+    constexpr u32 mgx_method_dictionary = 0x100;
+    constexpr u32 mgx_no_dictionary = 0xffffffff;
+
     struct Block
     {
         u64 offset;
         u64 compressed;
         u64 uncompressed;
         u32 method;
+
+        Compressor::Method getMethod() const
+        {
+            return Compressor::Method(method & mgx_method_mask);
+        }
+
+        bool isDictionaryCompressed() const
+        {
+            return (method & mgx_method_dictionary) != 0;
+        }
     };
 
     struct FileHeader
@@ -60,6 +78,8 @@ namespace
         ConstMemory m_memory;
         fs::Indexer<FileHeader> m_folders;
         std::vector<Block> m_blocks;
+        Dictionary m_dictionary;
+        Buffer m_dictionary_buffer;
 
         HeaderMGX(ConstMemory memory)
             : m_memory(memory)
@@ -89,13 +109,11 @@ namespace
             u64 block_offset = p.read64();
             u64 file_offset = p.read64();
 
-            read_blocks(memory.address + block_offset);
+            read_blocks(memory.address + block_offset, version);
             read_files(memory.address + file_offset);
-
-            MANGO_UNREFERENCED(version);
         }
 
-        void read_blocks(LittleEndianConstPointer p)
+        void read_blocks(LittleEndianConstPointer p, u32 version)
         {
             u32 magic1 = p.read32();
             if (magic1 != u32_mask('m', 'g', 'x', '1'))
@@ -114,6 +132,15 @@ namespace
                 m_blocks.push_back(block);
             }
 
+            if (version >= 2)
+            {
+                u32 dictionary = p.read32();
+                if (dictionary != mgx_no_dictionary)
+                {
+                    read_dictionary(dictionary);
+                }
+            }
+
             u32 magic2 = p.read32();
             if (magic2 != u32_mask('m', 'g', 'x', '2'))
             {
@@ -121,6 +148,30 @@ namespace
             }
         }
 
+        void read_dictionary(u32 index)
+        {
+            if (index >= m_blocks.size())
+            {
+                MANGO_EXCEPTION("[mapper.mgx] Incorrect dictionary block (%d)", index);
+            }
+
+            const Block& block = m_blocks[index];
+            ConstMemory src(m_memory.address + block.offset, size_t(block.compressed));
+
+            if (block.method)
+            {
+                m_dictionary_buffer.resize(size_t(block.uncompressed));
+                Compressor compressor = getCompressor(block.getMethod());
+                compressor.decompress(m_dictionary_buffer, src);
+                m_dictionary = Dictionary(m_dictionary_buffer);
+            }
+            else
+            {
+                // the dictionary is used directly from the parent memory
+                m_dictionary = Dictionary(src);
+            }
+        }
+
         void read_files(LittleEndianConstPointer p)
         {
             u32 magic2 = p.read32();
@@ -162,7 +213,7 @@ namespace
                 }
 
                 std::string folder = header.isFolder() ?
-                    fs::getPath(filename.substr(0, length - 1)) :
+                    fs::getPath(StringView(filename).substr(0, length - 1)) :
                     fs::getPath(filename);
 
                 header.filename = filename.substr(folder.length());
@@ -186,7 +237,7 @@ namespace filesystem {
     // VirtualMemoryMGX
     // -----------------------------------------------------------------
 
-    class VirtualMemoryMGX : public mango::VirtualMemory
+    class VirtualMemoryMGX : public mango::VirtualMemory, public mango::SlabObject<VirtualMemoryMGX>
     {
     protected:
         const u8* m_delete_address;
@@ -321,23 +372,53 @@ namespace filesystem {
             {
                 const Block& block = m_header.m_blocks[segment.block];
 
-                if (block.method)
+                if (block.isDictionaryCompressed())
+                {
+                    Compressor compressor = getCompressor(block.getMethod());
+                    if (!compressor.decompress_dict)
+                    {
+                        MANGO_EXCEPTION("[mapper.mgx] Compressor \"%s\" does not support dictionary.", compressor.name.c_str());
+                    }
+
+                    ConstMemory src(m_header.m_memory.address + block.offset, size_t(block.compressed));
+                    Dictionary dictionary = m_header.m_dictionary;
+
+                    q.enqueue([=, &block, &segment]
+                    {
+                        // the digested dictionary is cached in the worker thread
+                        if (block.uncompressed == segment.size && segment.offset == 0)
+                        {
+                            Memory dest(x, size_t(block.uncompressed));
+                            compressor.decompress_dict(dest, src, dictionary);
+                        }
+                        else
+                        {
+                            Buffer dest(size_t(block.uncompressed));
+                            compressor.decompress_dict(dest, src, dictionary);
+                            std::memcpy(x, Memory(dest).address + segment.offset, segment.size);
+                        }
+                    });
+                }
+                else if (block.method)
                 {
-                    Compressor compressor = getCompressor(Compressor::Method(block.method));
+                    Compressor::Method method = block.getMethod();
                     ConstMemory src(m_header.m_memory.address + block.offset, size_t(block.compressed));
 
                     q.enqueue([=, &block, &segment]
                     {
+                        // the worker thread re-uses it's decompressor state between blocks
+                        DecompressContext& context = getThreadDecompressContext(method);
+
                         if (block.uncompressed == segment.size && segment.offset == 0)
                         {
                             // segment is full-block so we can decode directly w/o intermediate buffer
                             Memory dest(x, size_t(block.uncompressed));
-                            compressor.decompress(dest, src);
+                            context.decompress(dest, src);
                         }
                         else
                         {
                             Buffer dest(size_t(block.uncompressed));
-                            compressor.decompress(dest, src);
+                            context.decompress(dest, src);
                             std::memcpy(x, Memory(dest).address + segment.offset, segment.size);
                         }
                     });
@@ -34,7 +34,7 @@ namespace
     using mango::u32;
     using mango::u64;
 
-    class VirtualMemoryRAR : public mango::VirtualMemory
+    class VirtualMemoryRAR : public mango::VirtualMemory, public mango::SlabObject<VirtualMemoryRAR>
     {
     protected:
         const u8* m_delete_address;
@@ -458,7 +458,7 @@ namespace filesystem {
                 std::string filename = header.filename;
                 while (!filename.empty())
                 {
-                    std::string folder = getPath(filename.substr(0, filename.length() - 1));
+                    std::string folder = getPathView(StringView(filename).substr(0, filename.length() - 1));
 
                     header.filename = filename.substr(folder.length());
                     m_folders.insert(folder, filename, header);
@@ -12,8 +12,6 @@
 
 #ifdef MANGO_ENABLE_ARCHIVE_ZIP
 
-#include "../../external/libdeflate/libdeflate.h"
-
 /*
 https://courses.cs.ut.ee/MTAT.07.022/2015_fall/uploads/Main/dmitri-report-f15-16.pdf
 
@@ -490,38 +488,18 @@ namespace
 
 	u64 zip_decompress(const u8* compressed, u8* uncompressed, u64 compressedLen, u64 uncompressedLen)
 	{
-        libdeflate_decompressor* decompressor = libdeflate_alloc_decompressor();
-
-        size_t bytes_out = 0;
-        libdeflate_result result = libdeflate_deflate_decompress(decompressor,
-            compressed, compressedLen,
-            uncompressed, uncompressedLen, &bytes_out);
-
-        libdeflate_free_decompressor(decompressor);
+        // the decompressor is re-used for all files decompressed in this thread
+        DecompressContext& context = getThreadDecompressContext(Compressor::DEFLATE);
 
-        const char* error = nullptr;
-        switch (result)
+        try
         {
-            default:
-            case LIBDEFLATE_SUCCESS:
-                break;
-            case LIBDEFLATE_BAD_DATA:
-                error = "Bad data";
-                break;
-            case LIBDEFLATE_SHORT_OUTPUT:
-                error = "Short output";
-                break;
-            case LIBDEFLATE_INSUFFICIENT_SPACE:
-                error = "Insufficient space";
-                break;
+            return context.decompress(Memory(uncompressed, size_t(uncompressedLen)),
+                                      ConstMemory(compressed, size_t(compressedLen)));
         }
-
-        if (error)
+        catch (const Exception& exception)
         {
-            MANGO_EXCEPTION("[mapper.zip] %s.", error);
+            MANGO_EXCEPTION("[mapper.zip] %s", exception.what());
         }
-
-        return bytes_out;
     }
 
 } // namespace
@@ -533,7 +511,7 @@ namespace filesystem {
     // VirtualMemoryZIP
     // -----------------------------------------------------------------
 
-    class VirtualMemoryZIP : public mango::VirtualMemory
+    class VirtualMemoryZIP : public mango::VirtualMemory, public mango::SlabObject<VirtualMemoryZIP>
     {
     protected:
         const u8* m_delete_address;
@@ -584,7 +562,7 @@ namespace filesystem {
                             std::string filename = header.filename;
                             while (!filename.empty())
                             {
-                                std::string folder = getPath(filename.substr(0, filename.length() - 1));
+                                std::string folder = getPathView(StringView(filename).substr(0, filename.length() - 1));
 
                                 header.filename = filename.substr(folder.length());
                                 m_folders.insert(folder, filename, header);
@@ -721,8 +699,9 @@ namespace filesystem {
                     address = p;
                     u64 compressed_size = header.compressedSize - 4;
 
-                    lzma::decompress(Memory(uncompressed_buffer, size_t(header.uncompressedSize)),
-                                     ConstMemory(address, size_t(compressed_size)));
+                    DecompressContext& context = getThreadDecompressContext(Compressor::LZMA);
+                    context.decompress(Memory(uncompressed_buffer, size_t(header.uncompressedSize)),
+                                       ConstMemory(address, size_t(compressed_size)));
 
                     delete[] buffer;
                     buffer = uncompressed_buffer;
@@ -50,40 +50,55 @@ namespace filesystem {
     // filename manipulation functions
     // -----------------------------------------------------------------
 
-    std::string getPath(const std::string& filename)
+    StringView getPathView(StringView filename)
     {
-        size_t n = filename.find_last_of("/\\:");
-        std::string s;
-        if (n != std::string::npos)
-            s = filename.substr(0, n + 1);
-        return s;
+        size_t n = findLastOf(filename, "/\\:");
+        if (n == StringView::npos)
+            return StringView();
+        return filename.substr(0, n + 1);
     }
 
-    std::string removePath(const std::string& filename)
+    StringView removePathView(StringView filename)
     {
-        size_t n = filename.find_last_of("/\\:");
-        std::string s;
-        if (n != std::string::npos)
-            s = filename.substr(n + 1);
-        else
-            s = filename;
-        return s;
+        size_t n = findLastOf(filename, "/\\:");
+        if (n == StringView::npos)
+            return filename;
+        return filename.substr(n + 1);
     }
 
-    std::string getExtension(const std::string& filename)
+    StringView getExtensionView(StringView filename)
     {
-        size_t n = filename.find_last_of('.');
-        std::string s;
-        if (n != std::string::npos)
-            s = filename.substr(n);
-        return s;
+        size_t n = findLastOf(filename, ".");
+        if (n == StringView::npos)
+            return StringView();
+        return filename.substr(n);
     }
 
-    std::string removeExtension(const std::string& filename)
+    StringView removeExtensionView(StringView filename)
     {
-        size_t n = filename.find_last_of('.');
+        size_t n = findLastOf(filename, ".");
         return filename.substr(0, n);
     }
 
+    std::string getPath(StringView filename)
+    {
+        return getPathView(filename);
+    }
+
+    std::string removePath(StringView filename)
+    {
+        return removePathView(filename);
+    }
+
+    std::string getExtension(StringView filename)
+    {
+        return getExtensionView(filename);
+    }
+
+    std::string removeExtension(StringView filename)
+    {
+        return removeExtensionView(filename);
+    }
+
 } // namespace filesystem
 } // namespace mango
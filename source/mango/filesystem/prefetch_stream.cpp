@@ -0,0 +1,778 @@
+/*
+    MANGO Multimedia Development Platform
+    Copyright (C) 2012-2020 Twilight Finland 3D Oy Ltd. All rights reserved.
+*/
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <mango/core/string.hpp>
+#include <mango/core/memory.hpp>
+#include <mango/core/exception.hpp>
+#include <mango/filesystem/file.hpp>
+
+#if defined(MANGO_PLATFORM_UNIX)
+    #include <cerrno>
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <sys/uio.h>
+#endif
+
+#if defined(MANGO_PLATFORM_LINUX) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #include <sys/mman.h>
+        #include <sys/syscall.h>
+        #include <linux/io_uring.h>
+        #if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+            #define MANGO_ENABLE_IO_URING
+        #endif
+    #endif
+#endif
+
+namespace
+{
+    using namespace mango;
+
+    // -----------------------------------------------------------------
+    // native file
+    // -----------------------------------------------------------------
+
+#if defined(MANGO_PLATFORM_WINDOWS)
+
+    using NativeHandle = HANDLE;
+
+    NativeHandle native_open(const std::string& filename)
+    {
+        HANDLE handle = CreateFileW(u16_fromBytes(filename).c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (handle == INVALID_HANDLE_VALUE)
+        {
+            MANGO_EXCEPTION("[PrefetchStream] File \"%s\" cannot be opened.", filename.c_str());
+        }
+        return handle;
+    }
+
+    void native_close(NativeHandle handle)
+    {
+        CloseHandle(handle);
+    }
+
+    u64 native_size(NativeHandle handle)
+    {
+        LARGE_INTEGER integer;
+        return GetFileSizeEx(handle, &integer) ? u64(integer.QuadPart) : 0;
+    }
+
+    // positional read; returns the number of bytes read or -1 on error
+    s64 native_read(NativeHandle handle, void* dest, size_t size, u64 offset)
+    {
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset);
+        overlapped.OffsetHigh = DWORD(offset >> 32);
+
+        DWORD bytes_read = 0;
+        if (!ReadFile(handle, dest, DWORD(size), &bytes_read, &overlapped))
+        {
+            return GetLastError() == ERROR_HANDLE_EOF ? 0 : -1;
+        }
+        return s64(bytes_read);
+    }
+
+#else
+
+    using NativeHandle = int;
+
+    NativeHandle native_open(const std::string& filename)
+    {
+        int fd = ::open(filename.c_str(), O_RDONLY);
+        if (fd == -1)
+        {
+            MANGO_EXCEPTION("[PrefetchStream] File \"%s\" cannot be opened.", filename.c_str());
+        }
+
+#if defined(POSIX_FADV_SEQUENTIAL)
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        return fd;
+    }
+
+    void native_close(NativeHandle handle)
+    {
+        ::close(handle);
+    }
+
+    u64 native_size(NativeHandle handle)
+    {
+        struct stat sb;
+        return ::fstat(handle, &sb) == 0 ? u64(sb.st_size) : 0;
+    }
+
+    // positional read; returns the number of bytes read or -1 on error
+    s64 native_read(NativeHandle handle, void* dest, size_t size, u64 offset)
+    {
+        for (;;)
+        {
+            ssize_t bytes = ::pread(handle, dest, size, off_t(offset));
+            if (bytes < 0 && errno == EINTR)
+                continue;
+            return s64(bytes);
+        }
+    }
+
+#endif
+
+    // -----------------------------------------------------------------
+    // PrefetchBlock
+    // -----------------------------------------------------------------
+
+    struct PrefetchBlock
+    {
+        enum Status
+        {
+            PENDING,
+            READY,
+            FAILED,
+        };
+
+        u8* data;
+        u64 offset;     // file offset of the block
+        size_t size;    // requested bytes
+        size_t bytes;   // completed bytes
+        Status status;
+
+#if defined(MANGO_ENABLE_IO_URING)
+        struct iovec iov;
+#endif
+    };
+
+    // -----------------------------------------------------------------
+    // PrefetchBackend
+    // -----------------------------------------------------------------
+
+    struct PrefetchBackend
+    {
+        virtual ~PrefetchBackend() {}
+
+        // start reading the remaining bytes of the block
+        virtual void submit(PrefetchBlock* block) = 0;
+
+        // block until the block is not PENDING
+        virtual void wait(PrefetchBlock* block) = 0;
+    };
+
+    // -----------------------------------------------------------------
+    // ThreadBackend
+    // -----------------------------------------------------------------
+
+    class ThreadBackend : public PrefetchBackend
+    {
+    protected:
+        NativeHandle m_file;
+        std::thread m_thread;
+        std::mutex m_mutex;
+        std::condition_variable m_submit_condition;
+        std::condition_variable m_complete_condition;
+        std::deque<PrefetchBlock*> m_queue;
+        bool m_stop;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            for (;;)
+            {
+                m_submit_condition.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_stop)
+                    break;
+
+                PrefetchBlock* block = m_queue.front();
+                m_queue.pop_front();
+
+                // the consumer does not touch the block until it is completed
+                lock.unlock();
+
+                PrefetchBlock::Status status = PrefetchBlock::READY;
+                size_t bytes = block->bytes;
+
+                while (bytes < block->size)
+                {
+                    s64 result = native_read(m_file, block->data + bytes, block->size - bytes, block->offset + bytes);
+                    if (result <= 0)
+                    {
+                        status = result < 0 ? PrefetchBlock::FAILED : PrefetchBlock::READY;
+                        break;
+                    }
+                    bytes += size_t(result);
+                }
+
+                lock.lock();
+
+                block->bytes = bytes;
+                block->status = status;
+                m_complete_condition.notify_all();
+            }
+        }
+
+    public:
+        ThreadBackend(NativeHandle file)
+            : m_file(file)
+            , m_stop(false)
+        {
+            m_thread = std::thread([this] { run(); });
+        }
+
+        ~ThreadBackend()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+
+            m_submit_condition.notify_one();
+            m_thread.join();
+        }
+
+        void submit(PrefetchBlock* block) override
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            block->status = PrefetchBlock::PENDING;
+            m_queue.push_back(block);
+            m_submit_condition.notify_one();
+        }
+
+        void wait(PrefetchBlock* block) override
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_complete_condition.wait(lock, [block] { return block->status != PrefetchBlock::PENDING; });
+        }
+    };
+
+#if defined(MANGO_ENABLE_IO_URING)
+
+    // -----------------------------------------------------------------
+    // UringBackend
+    // -----------------------------------------------------------------
+
+    // The rings are accessed directly with the system calls, so that the
+    // library does not depend on liburing.
+
+    class UringBackend : public PrefetchBackend
+    {
+    protected:
+        int m_file;
+        int m_ring;
+
+        void* m_sq_pointer;
+        void* m_cq_pointer;
+        size_t m_sq_bytes;
+        size_t m_cq_bytes;
+        struct io_uring_sqe* m_sqes;
+        size_t m_sqes_bytes;
+
+        u32* m_sq_tail;
+        u32* m_sq_mask;
+        u32* m_sq_array;
+
+        u32* m_cq_head;
+        u32* m_cq_tail;
+        u32* m_cq_mask;
+        struct io_uring_cqe* m_cqes;
+
+        int enter(u32 submit, u32 complete, u32 flags)
+        {
+            for (;;)
+            {
+                int result = int(::syscall(__NR_io_uring_enter, m_ring, submit, complete, flags, nullptr, 0));
+                if (result < 0 && errno == EINTR)
+                    continue;
+                return result;
+            }
+        }
+
+        void reap()
+        {
+            u32 head = *m_cq_head;
+
+            while (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+            {
+                struct io_uring_cqe* cqe = &m_cqes[head & *m_cq_mask];
+                PrefetchBlock* block = reinterpret_cast<PrefetchBlock*>(uintptr_t(cqe->user_data));
+                int result = cqe->res;
+
+                ++head;
+                __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+
+                if (result < 0)
+                {
+                    if (result == -EINTR || result == -EAGAIN)
+                        submit(block);
+                    else
+                        block->status = PrefetchBlock::FAILED;
+                }
+                else if (result == 0)
+                {
+                    // end of file
+                    block->status = PrefetchBlock::READY;
+                }
+                else
+                {
+                    block->bytes += size_t(result);
+                    if (block->bytes < block->size)
+                        submit(block); // short read
+                    else
+                        block->status = PrefetchBlock::READY;
+                }
+            }
+        }
+
+    public:
+        UringBackend(int file, u32 depth)
+            : m_file(file)
+            , m_ring(-1)
+            , m_sq_pointer(MAP_FAILED)
+            , m_cq_pointer(MAP_FAILED)
+            , m_sq_bytes(0)
+            , m_cq_bytes(0)
+            , m_sqes(nullptr)
+            , m_sqes_bytes(0)
+        {
+            struct io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            m_ring = int(::syscall(__NR_io_uring_setup, depth, &params));
+            if (m_ring < 0)
+            {
+                return;
+            }
+
+            m_sq_bytes = params.sq_off.array + params.sq_entries * sizeof(u32);
+            m_cq_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                m_sq_bytes = std::max(m_sq_bytes, m_cq_bytes);
+                m_cq_bytes = m_sq_bytes;
+            }
+
+            m_sq_pointer = ::mmap(nullptr, m_sq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+            if (m_sq_pointer == MAP_FAILED)
+            {
+                return;
+            }
+
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                m_cq_pointer = m_sq_pointer;
+            }
+            else
+            {
+                m_cq_pointer = ::mmap(nullptr, m_cq_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_CQ_RING);
+                if (m_cq_pointer == MAP_FAILED)
+                {
+                    return;
+                }
+            }
+
+            m_sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+            void* sqes = ::mmap(nullptr, m_sqes_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQES);
+            if (sqes == MAP_FAILED)
+            {
+                return;
+            }
+
+            m_sqes = reinterpret_cast<struct io_uring_sqe*>(sqes);
+
+            u8* sq = reinterpret_cast<u8*>(m_sq_pointer);
+            m_sq_tail = reinterpret_cast<u32*>(sq + params.sq_off.tail);
+            m_sq_mask = reinterpret_cast<u32*>(sq + params.sq_off.ring_mask);
+            m_sq_array = reinterpret_cast<u32*>(sq + params.sq_off.array);
+
+            u8* cq = reinterpret_cast<u8*>(m_cq_pointer);
+            m_cq_head = reinterpret_cast<u32*>(cq + params.cq_off.head);
+            m_cq_tail = reinterpret_cast<u32*>(cq + params.cq_off.tail);
+            m_cq_mask = reinterpret_cast<u32*>(cq + params.cq_off.ring_mask);
+            m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        ~UringBackend()
+        {
+            if (m_sqes)
+            {
+                ::munmap(m_sqes, m_sqes_bytes);
+            }
+
+            if (m_cq_pointer != MAP_FAILED && m_cq_pointer != m_sq_pointer)
+            {
+                ::munmap(m_cq_pointer, m_cq_bytes);
+            }
+
+            if (m_sq_pointer != MAP_FAILED)
+            {
+                ::munmap(m_sq_pointer, m_sq_bytes);
+            }
+
+            if (m_ring >= 0)
+            {
+                ::close(m_ring);
+            }
+        }
+
+        bool valid() const
+        {
+            return m_sqes != nullptr;
+        }
+
+        void submit(PrefetchBlock* block) override
+        {
+            block->status = PrefetchBlock::PENDING;
+            block->iov.iov_base = block->data + block->bytes;
+            block->iov.iov_len = block->size - block->bytes;
+
+            // every block has at most one read in flight and the ring has an entry
+            // for every block so the submission queue cannot overflow
+            u32 tail = *m_sq_tail;
+            u32 index = tail & *m_sq_mask;
+
+            struct io_uring_sqe* sqe = &m_sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_READV;
+            sqe->fd = m_file;
+            sqe->addr = u64(uintptr_t(&block->iov));
+            sqe->len = 1;
+            sqe->off = block->offset + block->bytes;
+            sqe->user_data = u64(uintptr_t(block));
+
+            m_sq_array[index] = index;
+            __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+            if (enter(1, 0, 0) < 0)
+            {
+                block->status = PrefetchBlock::FAILED;
+            }
+        }
+
+        void wait(PrefetchBlock* block) override
+        {
+            reap();
+
+            while (block->status == PrefetchBlock::PENDING)
+            {
+                if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+                {
+                    block->status = PrefetchBlock::FAILED;
+                    break;
+                }
+
+                reap();
+            }
+        }
+    };
+
+#endif // MANGO_ENABLE_IO_URING
+
+} // namespace
+
+namespace mango {
+namespace filesystem {
+
+    // -----------------------------------------------------------------
+    // PrefetchHandle
+    // -----------------------------------------------------------------
+
+    struct PrefetchHandle
+    {
+        std::string m_filename;
+        NativeHandle m_file;
+        u64 m_size;
+
+        std::unique_ptr<PrefetchBackend> m_backend;
+        std::vector<PrefetchBlock> m_blocks;
+        size_t m_block_size;
+
+        u64 m_next;         // file offset of the next block to be submitted
+        size_t m_head;      // current block in the ring
+        size_t m_cursor;    // consumed bytes in the current block
+        bool m_waited;      // the current block has been completed
+        bool m_acquired;    // the current block is lent out by acquire()
+
+        PrefetchHandle(const std::string& filename, size_t block_size, u32 depth, PrefetchStream::Backend backend)
+            : m_filename(filename)
+            , m_file(native_open(filename))
+            , m_size(native_size(m_file))
+            , m_block_size(std::max((block_size + 4095) & ~size_t(4095), size_t(4096)))
+            , m_next(0)
+            , m_head(0)
+            , m_cursor(0)
+            , m_waited(false)
+            , m_acquired(false)
+        {
+            depth = std::max(depth, 2u);
+
+#if defined(MANGO_ENABLE_IO_URING)
+            if (backend == PrefetchStream::DEFAULT)
+            {
+                UringBackend* uring = new UringBackend(m_file, depth);
+                if (uring->valid())
+                    m_backend.reset(uring);
+                else
+                    delete uring;
+            }
+#else
+            MANGO_UNREFERENCED(backend);
+#endif
+
+            if (!m_backend)
+            {
+                m_backend.reset(new ThreadBackend(m_file));
+            }
+
+            m_blocks.resize(depth);
+
+            for (auto& block : m_blocks)
+            {
+                block.data = reinterpret_cast<u8*>(aligned_malloc(m_block_size, Alignment(4096)));
+                block.status = PrefetchBlock::READY;
+                block.size = 0;
+            }
+
+            start(0);
+        }
+
+        ~PrefetchHandle()
+        {
+            drain();
+            m_backend.reset();
+
+            for (auto& block : m_blocks)
+            {
+                aligned_free(block.data);
+            }
+
+            native_close(m_file);
+        }
+
+        void submit(PrefetchBlock& block)
+        {
+            block.offset = m_next;
+            block.size = size_t(std::min(u64(m_block_size), m_size - std::min(m_next, m_size)));
+            block.bytes = 0;
+            m_next += block.size;
+
+            if (block.size)
+            {
+                m_backend->submit(&block);
+            }
+            else
+            {
+                // past the end of the file
+                block.status = PrefetchBlock::READY;
+            }
+        }
+
+        void drain()
+        {
+            for (auto& block : m_blocks)
+            {
+                m_backend->wait(&block);
+            }
+        }
+
+        void start(u64 offset)
+        {
+            u64 base = offset - offset % m_block_size;
+
+            m_next = base;
+            m_head = 0;
+            m_cursor = size_t(offset - base);
+            m_waited = false;
+            m_acquired = false;
+
+            for (auto& block : m_blocks)
+            {
+                submit(block);
+            }
+        }
+
+        PrefetchBlock& current()
+        {
+            if (m_acquired)
+            {
+                m_acquired = false;
+                advance();
+            }
+
+            PrefetchBlock& block = m_blocks[m_head];
+
+            if (!m_waited)
+            {
+                m_backend->wait(&block);
+                m_waited = true;
+
+                if (block.status == PrefetchBlock::FAILED)
+                {
+                    MANGO_EXCEPTION("[PrefetchStream] Reading \"%s\" failed.", m_filename.c_str());
+                }
+            }
+
+            return block;
+        }
+
+        void advance()
+        {
+            // recycle the consumed block for reading further ahead
+            submit(m_blocks[m_head]);
+
+            m_head = (m_head + 1) % m_blocks.size();
+            m_cursor = 0;
+            m_waited = false;
+        }
+
+        u64 offset() const
+        {
+            const PrefetchBlock& block = m_blocks[m_head];
+            return std::min(block.offset + m_cursor, m_size);
+        }
+
+        void seek(u64 target)
+        {
+            if (!m_acquired && m_waited)
+            {
+                const PrefetchBlock& block = m_blocks[m_head];
+                if (target >= block.offset && target < block.offset + block.bytes)
+                {
+                    // the target is in the current block
+                    m_cursor = size_t(target - block.offset);
+                    return;
+                }
+            }
+
+            drain();
+            start(target);
+        }
+
+        void read(u8* dest, size_t size)
+        {
+            while (size > 0)
+            {
+                PrefetchBlock& block = current();
+                if (m_cursor >= block.bytes)
+                {
+                    if (block.bytes < m_block_size || !block.size)
+                    {
+                        // end of file
+                        break;
+                    }
+
+                    advance();
+                    continue;
+                }
+
+                size_t bytes = std::min(size, block.bytes - m_cursor);
+                std::memcpy(dest, block.data + m_cursor, bytes);
+                m_cursor += bytes;
+                dest += bytes;
+                size -= bytes;
+            }
+        }
+
+        ConstMemory acquire()
+        {
+            for (;;)
+            {
+                PrefetchBlock& block = current();
+                if (m_cursor < block.bytes)
+                {
+                    ConstMemory memory(block.data + m_cursor, block.bytes - m_cursor);
+                    m_cursor = block.bytes;
+                    m_acquired = true;
+                    return memory;
+                }
+
+                if (block.bytes < m_block_size || !block.size)
+                {
+                    // end of file
+                    return ConstMemory();
+                }
+
+                advance();
+            }
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // PrefetchStream
+    // -----------------------------------------------------------------
+
+    PrefetchStream::PrefetchStream(const std::string& filename, size_t block_size, u32 depth, Backend backend)
+        : m_handle(nullptr)
+    {
+        m_handle = new PrefetchHandle(filename, block_size, depth, backend);
+    }
+
+    PrefetchStream::~PrefetchStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& PrefetchStream::filename() const
+    {
+        return m_handle->m_filename;
+    }
+
+    u64 PrefetchStream::size() const
+    {
+        return m_handle->m_size;
+    }
+
+    u64 PrefetchStream::offset() const
+    {
+        return m_handle->offset();
+    }
+
+    void PrefetchStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+
+            case CURRENT:
+                target = m_handle->offset() + distance;
+                break;
+
+            case END:
+                target = m_handle->m_size + distance;
+                break;
+
+            default:
+                MANGO_EXCEPTION("[PrefetchStream] Invalid seek mode.");
+        }
+
+        m_handle->seek(target);
+    }
+
+    void PrefetchStream::read(void* dest, size_t size)
+    {
+        m_handle->read(reinterpret_cast<u8*>(dest), size);
+    }
+
+    void PrefetchStream::write(const void* data, size_t size)
+    {
+        MANGO_UNREFERENCED(data);
+        MANGO_UNREFERENCED(size);
+        MANGO_EXCEPTION("[PrefetchStream] Stream is not writable.");
+    }
+
+    ConstMemory PrefetchStream::acquire()
+    {
+        return m_handle->acquire();
+    }
+
+} // namespace filesystem
+} // namespace mango
@@ -6,8 +6,14 @@
 #define _FILE_OFFSET_BITS 64 /* LFS: 64 bit off_t */
 #endif
 #include <cstdio>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
@@ -155,5 +161,626 @@ namespace filesystem {
 		m_handle->write(data, size);
     }
 
+    // -----------------------------------------------------------------
+    // NativeFileHandle
+    // -----------------------------------------------------------------
+
+    // direct I/O transfers are aligned to the logical block size
+    static const size_t native_block_size = 4096;
+
+    struct NativeFileHandle
+    {
+        std::string m_filename;
+        int m_fd;
+        Stream::OpenMode m_mode;
+        bool m_direct;
+
+        u8* m_buffer;
+        size_t m_capacity;
+        size_t m_count;     // WRITE: pending bytes, READ: valid bytes in the buffer
+        size_t m_cursor;    // READ: consumed bytes in the buffer
+        u64 m_position;     // file offset of the start of the buffer
+        u64 m_size;
+
+        NativeFileHandle(const std::string& filename, Stream::OpenMode mode, u32 flags, size_t buffer_size)
+            : m_filename(filename)
+            , m_fd(-1)
+            , m_mode(mode)
+            , m_direct(false)
+            , m_buffer(nullptr)
+            , m_capacity(std::max((buffer_size + native_block_size - 1) & ~(native_block_size - 1), native_block_size))
+            , m_count(0)
+            , m_cursor(0)
+            , m_position(0)
+            , m_size(0)
+        {
+            if (mode == Stream::READ)
+            {
+                m_fd = ::open(filename.c_str(), O_RDONLY);
+            }
+            else
+            {
+                const int oflags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+                if (flags & NativeFileStream::DIRECT)
+                {
+                    // not all file systems support direct I/O; fall back to the file cache
+                    m_fd = ::open(filename.c_str(), oflags | O_DIRECT, 0644);
+                    m_direct = m_fd != -1;
+                }
+#endif
+                if (m_fd == -1)
+                {
+                    m_fd = ::open(filename.c_str(), oflags, 0644);
+                }
+
+#ifdef F_NOCACHE
+                if (m_fd != -1 && (flags & NativeFileStream::DIRECT))
+                {
+                    ::fcntl(m_fd, F_NOCACHE, 1);
+                }
+#endif
+            }
+
+            if (m_fd == -1)
+            {
+                MANGO_EXCEPTION("[NativeFileStream] File \"%s\" cannot be opened.", filename.c_str());
+            }
+
+            if (mode == Stream::READ)
+            {
+                struct stat sb;
+                if (::fstat(m_fd, &sb) == 0)
+                {
+                    m_size = u64(sb.st_size);
+                }
+            }
+
+            m_buffer = reinterpret_cast<u8*>(aligned_malloc(m_capacity, Alignment(native_block_size)));
+        }
+
+        ~NativeFileHandle()
+        {
+            if (m_mode == Stream::WRITE)
+            {
+                try
+                {
+                    flush();
+                }
+                catch (...)
+                {
+                }
+            }
+
+            ::close(m_fd);
+            aligned_free(m_buffer);
+        }
+
+        u64 size() const
+        {
+            return m_mode == Stream::WRITE ? std::max(m_size, m_position + m_count) : m_size;
+        }
+
+        u64 offset() const
+        {
+            return m_position + (m_mode == Stream::WRITE ? m_count : m_cursor);
+        }
+
+        void seek(u64 target)
+        {
+            if (m_mode == Stream::READ)
+            {
+                if (target >= m_position && target <= m_position + m_count)
+                {
+                    // the target is in the buffer
+                    m_cursor = size_t(target - m_position);
+                    return;
+                }
+
+                m_count = 0;
+                m_cursor = 0;
+            }
+            else
+            {
+                flush();
+
+                if (target & (native_block_size - 1))
+                {
+                    end_direct();
+                }
+            }
+
+            ::lseek(m_fd, off_t(target), SEEK_SET);
+            m_position = target;
+        }
+
+        void end_direct()
+        {
+#ifdef O_DIRECT
+            if (m_direct)
+            {
+                // the rest of the I/O is not block aligned
+                int flags = ::fcntl(m_fd, F_GETFL);
+                ::fcntl(m_fd, F_SETFL, flags & ~O_DIRECT);
+                m_direct = false;
+            }
+#endif
+        }
+
+        void writev_all(struct iovec* iov, int count)
+        {
+            while (count > 0)
+            {
+                ssize_t bytes = ::writev(m_fd, iov, count);
+                if (bytes < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    MANGO_EXCEPTION("[NativeFileStream] Writing to \"%s\" failed.", m_filename.c_str());
+                }
+
+                m_position += u64(bytes);
+
+                // skip the completed spans
+                size_t written = size_t(bytes);
+                while (count > 0 && written >= iov->iov_len)
+                {
+                    written -= iov->iov_len;
+                    ++iov;
+                    --count;
+                }
+
+                if (count > 0)
+                {
+                    iov->iov_base = reinterpret_cast<u8*>(iov->iov_base) + written;
+                    iov->iov_len -= written;
+                }
+            }
+
+            m_size = std::max(m_size, m_position);
+        }
+
+        void flush()
+        {
+            if (m_mode != Stream::WRITE || !m_count)
+                return;
+
+            if (m_count & (native_block_size - 1))
+            {
+                end_direct();
+            }
+
+            struct iovec iov = { m_buffer, m_count };
+            m_count = 0;
+            writev_all(&iov, 1);
+        }
+
+        void write(const u8* data, size_t size)
+        {
+            if (m_count + size <= m_capacity)
+            {
+                std::memcpy(m_buffer + m_count, data, size);
+                m_count += size;
+                if (m_count == m_capacity)
+                {
+                    flush();
+                }
+                return;
+            }
+
+            if (m_direct || size < m_capacity / 2)
+            {
+                // direct I/O has to go through the aligned buffer
+                while (size > 0)
+                {
+                    size_t bytes = std::min(size, m_capacity - m_count);
+                    std::memcpy(m_buffer + m_count, data, bytes);
+                    m_count += bytes;
+                    data += bytes;
+                    size -= bytes;
+
+                    if (m_count == m_capacity)
+                    {
+                        flush();
+                    }
+                }
+                return;
+            }
+
+            // large write: gather the buffered data and the new data into one system call
+            struct iovec iov[2];
+            iov[0].iov_base = m_buffer;
+            iov[0].iov_len = m_count;
+            iov[1].iov_base = const_cast<u8*>(data);
+            iov[1].iov_len = size;
+
+            m_count = 0;
+            writev_all(iov, 2);
+        }
+
+        void write(const ConstMemory* spans, size_t count)
+        {
+            size_t total = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                total += spans[i].size;
+            }
+
+            if (m_direct || m_count + total <= m_capacity || total < m_capacity / 2)
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    write(spans[i].address, spans[i].size);
+                }
+                return;
+            }
+
+            const size_t max_iov = 1024; // IOV_MAX
+            std::vector<struct iovec> iov;
+            iov.reserve(std::min(count + 1, max_iov));
+
+            if (m_count)
+            {
+                iov.push_back({ m_buffer, m_count });
+                m_count = 0;
+            }
+
+            for (size_t i = 0; i < count; ++i)
+            {
+                iov.push_back({ const_cast<u8*>(spans[i].address), spans[i].size });
+                if (iov.size() == max_iov)
+                {
+                    writev_all(iov.data(), int(iov.size()));
+                    iov.clear();
+                }
+            }
+
+            writev_all(iov.data(), int(iov.size()));
+        }
+
+        void read(u8* dest, size_t size)
+        {
+            size_t available = m_count - m_cursor;
+            if (size <= available)
+            {
+                std::memcpy(dest, m_buffer + m_cursor, size);
+                m_cursor += size;
+                return;
+            }
+
+            std::memcpy(dest, m_buffer + m_cursor, available);
+            dest += available;
+            size -= available;
+
+            m_position += m_count;
+            m_count = 0;
+            m_cursor = 0;
+
+            // read into the destination and refill the buffer with the same system call
+            while (size > 0)
+            {
+                struct iovec iov[2];
+                iov[0].iov_base = dest;
+                iov[0].iov_len = size;
+                iov[1].iov_base = m_buffer;
+                iov[1].iov_len = m_capacity;
+
+                ssize_t bytes = ::readv(m_fd, iov, 2);
+                if (bytes < 0)
+                {
+                    if (errno == EINTR)
+                        continue;
+                    MANGO_EXCEPTION("[NativeFileStream] Reading from \"%s\" failed.", m_filename.c_str());
+                }
+
+                if (!bytes)
+                {
+                    // end of file
+                    break;
+                }
+
+                if (size_t(bytes) <= size)
+                {
+                    dest += bytes;
+                    size -= size_t(bytes);
+                    m_position += u64(bytes);
+                }
+                else
+                {
+                    m_position += size;
+                    m_count = size_t(bytes) - size;
+                    size = 0;
+                }
+            }
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // NativeFileStream
+    // -----------------------------------------------------------------
+
+    NativeFileStream::NativeFileStream(const std::string& filename, OpenMode mode, u32 flags, size_t buffer_size)
+        : m_handle(nullptr)
+    {
+        if (mode != READ && mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Incorrect OpenMode.");
+        }
+
+        m_handle = new NativeFileHandle(filename, mode, flags, buffer_size);
+    }
+
+    NativeFileStream::~NativeFileStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& NativeFileStream::filename() const
+    {
+        return m_handle->m_filename;
+    }
+
+    u64 NativeFileStream::size() const
+    {
+        return m_handle->size();
+    }
+
+    u64 NativeFileStream::offset() const
+    {
+        return m_handle->offset();
+    }
+
+    void NativeFileStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+
+            case CURRENT:
+                target = m_handle->offset() + distance;
+                break;
+
+            case END:
+                target = m_handle->size() + distance;
+                break;
+
+            default:
+                MANGO_EXCEPTION("[NativeFileStream] Invalid seek mode.");
+        }
+
+        m_handle->seek(target);
+    }
+
+    void NativeFileStream::read(void* dest, size_t size)
+    {
+        if (m_handle->m_mode != READ)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not readable.");
+        }
+
+        m_handle->read(reinterpret_cast<u8*>(dest), size);
+    }
+
+    void NativeFileStream::write(const void* data, size_t size)
+    {
+        if (m_handle->m_mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not writable.");
+        }
+
+        m_handle->write(reinterpret_cast<const u8*>(data), size);
+    }
+
+    void NativeFileStream::write(const ConstMemory* spans, size_t count)
+    {
+        if (m_handle->m_mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not writable.");
+        }
+
+        m_handle->write(spans, count);
+    }
+
+    void NativeFileStream::flush()
+    {
+        m_handle->flush();
+    }
+
+    // -----------------------------------------------------------------
+    // MappedFileHandle
+    // -----------------------------------------------------------------
+
+    struct MappedFileHandle
+    {
+        std::string m_filename;
+        int m_fd;
+        u8* m_address;
+        size_t m_capacity;
+        size_t m_size;
+        size_t m_offset;
+
+        MappedFileHandle(const std::string& filename, u64 reserve)
+            : m_filename(filename)
+            , m_fd(-1)
+            , m_address(nullptr)
+            , m_capacity(0)
+            , m_size(0)
+            , m_offset(0)
+        {
+            m_fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (m_fd == -1)
+            {
+                MANGO_EXCEPTION("[MappedFileStream] File \"%s\" cannot be opened.", filename.c_str());
+            }
+
+            if (reserve)
+            {
+                grow(size_t(reserve));
+            }
+        }
+
+        ~MappedFileHandle()
+        {
+            if (m_address)
+            {
+                ::munmap(m_address, m_capacity);
+            }
+
+            // discard the unused reserved space
+            int status = ::ftruncate(m_fd, off_t(m_size));
+            MANGO_UNREFERENCED(status);
+
+            ::close(m_fd);
+        }
+
+        void grow(size_t required)
+        {
+            if (required <= m_capacity)
+                return;
+
+            const size_t page_size = size_t(::getpagesize());
+            size_t capacity = std::max(std::max(required, m_capacity * 2), size_t(1024 * 1024));
+            capacity = (capacity + page_size - 1) & ~(page_size - 1);
+
+            if (::ftruncate(m_fd, off_t(capacity)) != 0)
+            {
+                MANGO_EXCEPTION("[MappedFileStream] Resizing \"%s\" failed.", m_filename.c_str());
+            }
+
+            void* address;
+
+#if defined(MANGO_PLATFORM_LINUX)
+            if (m_address)
+            {
+                // the mapping can grow in place or be moved without touching the pages
+                address = ::mremap(m_address, m_capacity, capacity, MREMAP_MAYMOVE);
+            }
+            else
+#endif
+            {
+                if (m_address)
+                {
+                    ::munmap(m_address, m_capacity);
+                    m_address = nullptr;
+                    m_capacity = 0;
+                }
+
+                address = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+            }
+
+            if (address == MAP_FAILED)
+            {
+                MANGO_EXCEPTION("[MappedFileStream] Mapping \"%s\" failed.", m_filename.c_str());
+            }
+
+            m_address = reinterpret_cast<u8*>(address);
+            m_capacity = capacity;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // MappedFileStream
+    // -----------------------------------------------------------------
+
+    MappedFileStream::MappedFileStream(const std::string& filename, u64 reserve)
+        : m_handle(nullptr)
+    {
+        m_handle = new MappedFileHandle(filename, reserve);
+    }
+
+    MappedFileStream::~MappedFileStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& MappedFileStream::filename() const
+    {
+        return m_handle->m_filename;
+    }
+
+    u64 MappedFileStream::size() const
+    {
+        return m_handle->m_size;
+    }
+
+    u64 MappedFileStream::offset() const
+    {
+        return m_handle->m_offset;
+    }
+
+    void MappedFileStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+
+            case CURRENT:
+                target = m_handle->m_offset + distance;
+                break;
+
+            case END:
+                target = m_handle->m_size + distance;
+                break;
+
+            default:
+                MANGO_EXCEPTION("[MappedFileStream] Invalid seek mode.");
+        }
+
+        // seeking past the end extends the file with zeros
+        m_handle->grow(size_t(target));
+        m_handle->m_offset = size_t(target);
+        m_handle->m_size = std::max(m_handle->m_size, m_handle->m_offset);
+    }
+
+    void MappedFileStream::read(void* dest, size_t size)
+    {
+        size_t offset = m_handle->m_offset;
+        if (offset + size > m_handle->m_size)
+        {
+            MANGO_EXCEPTION("[MappedFileStream] Reading past end of file.");
+        }
+
+        std::memcpy(dest, m_handle->m_address + offset, size);
+        m_handle->m_offset = offset + size;
+    }
+
+    void MappedFileStream::write(const void* data, size_t size)
+    {
+        Memory dest = acquire(size);
+        std::memcpy(dest.address, data, size);
+        commit(size);
+    }
+
+    Memory MappedFileStream::acquire(size_t bytes)
+    {
+        m_handle->grow(m_handle->m_offset + bytes);
+        return Memory(m_handle->m_address + m_handle->m_offset, bytes);
+    }
+
+    void MappedFileStream::commit(size_t bytes)
+    {
+        size_t offset = m_handle->m_offset + bytes;
+        if (offset > m_handle->m_capacity)
+        {
+            MANGO_EXCEPTION("[MappedFileStream] Commit exceeds the acquired memory.");
+        }
+
+        m_handle->m_offset = offset;
+        m_handle->m_size = std::max(m_handle->m_size, offset);
+    }
+
+    Memory MappedFileStream::memory() const
+    {
+        return Memory(m_handle->m_address, m_handle->m_size);
+    }
+
 } // namespace filesystem
 } // namespace mango
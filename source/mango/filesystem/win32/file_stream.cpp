@@ -2,6 +2,8 @@
     MANGO Multimedia Development Platform
     Copyright (C) 2012-2019 Twilight Finland 3D Oy Ltd. All rights reserved.
 */
+#include <algorithm>
+#include <cstring>
 #include <mango/core/string.hpp>
 #include <mango/core/exception.hpp>
 #include <mango/filesystem/file.hpp>
@@ -167,5 +169,510 @@ namespace filesystem {
 		m_handle->write(data, size);
     }
 
+    // -----------------------------------------------------------------
+    // NativeFileHandle
+    // -----------------------------------------------------------------
+
+    struct NativeFileHandle
+    {
+        std::string m_filename;
+        HANDLE m_handle;
+        Stream::OpenMode m_mode;
+
+        u8* m_buffer;
+        size_t m_capacity;
+        size_t m_count;     // WRITE: pending bytes, READ: valid bytes in the buffer
+        size_t m_cursor;    // READ: consumed bytes in the buffer
+        u64 m_position;     // file offset of the start of the buffer
+        u64 m_size;
+
+        NativeFileHandle(const std::string& filename, Stream::OpenMode mode, u32 flags, size_t buffer_size)
+            : m_filename(filename)
+            , m_handle(INVALID_HANDLE_VALUE)
+            , m_mode(mode)
+            , m_buffer(nullptr)
+            , m_capacity(std::max(buffer_size, size_t(4096)))
+            , m_count(0)
+            , m_cursor(0)
+            , m_position(0)
+            , m_size(0)
+        {
+            DWORD access = mode == Stream::READ ? GENERIC_READ : GENERIC_WRITE;
+            DWORD disposition = mode == Stream::READ ? OPEN_EXISTING : CREATE_ALWAYS;
+            DWORD attributes = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN;
+
+            // FILE_FLAG_NO_BUFFERING would require sector aligned writes; write-through
+            // is the closest unaligned equivalent to bypassing the cache
+            if (mode == Stream::WRITE && (flags & NativeFileStream::DIRECT))
+            {
+                attributes |= FILE_FLAG_WRITE_THROUGH;
+            }
+
+            m_handle = CreateFileW(u16_fromBytes(filename).c_str(), access, 0, NULL, disposition, attributes, NULL);
+            if (m_handle == INVALID_HANDLE_VALUE)
+            {
+                MANGO_EXCEPTION("[NativeFileStream] File \"%s\" cannot be opened.", filename.c_str());
+            }
+
+            if (mode == Stream::READ)
+            {
+                LARGE_INTEGER integer;
+                if (GetFileSizeEx(m_handle, &integer))
+                {
+                    m_size = u64(integer.QuadPart);
+                }
+            }
+
+            m_buffer = new u8[m_capacity];
+        }
+
+        ~NativeFileHandle()
+        {
+            if (m_mode == Stream::WRITE)
+            {
+                try
+                {
+                    flush();
+                }
+                catch (...)
+                {
+                }
+            }
+
+            CloseHandle(m_handle);
+            delete[] m_buffer;
+        }
+
+        u64 size() const
+        {
+            return m_mode == Stream::WRITE ? std::max(m_size, m_position + m_count) : m_size;
+        }
+
+        u64 offset() const
+        {
+            return m_position + (m_mode == Stream::WRITE ? m_count : m_cursor);
+        }
+
+        void seek(u64 target)
+        {
+            if (m_mode == Stream::READ)
+            {
+                if (target >= m_position && target <= m_position + m_count)
+                {
+                    // the target is in the buffer
+                    m_cursor = size_t(target - m_position);
+                    return;
+                }
+
+                m_count = 0;
+                m_cursor = 0;
+            }
+            else
+            {
+                flush();
+            }
+
+            LARGE_INTEGER dist;
+            dist.QuadPart = target;
+            SetFilePointerEx(m_handle, dist, NULL, FILE_BEGIN);
+            m_position = target;
+        }
+
+        void write_all(const u8* data, size_t size)
+        {
+            while (size > 0)
+            {
+                DWORD bytes = static_cast<DWORD>(std::min(size, size_t(0x40000000)));
+                DWORD bytes_written = 0;
+                if (!WriteFile(m_handle, data, bytes, &bytes_written, NULL))
+                {
+                    MANGO_EXCEPTION("[NativeFileStream] Writing to \"%s\" failed.", m_filename.c_str());
+                }
+
+                data += bytes_written;
+                size -= bytes_written;
+                m_position += bytes_written;
+            }
+
+            m_size = std::max(m_size, m_position);
+        }
+
+        void flush()
+        {
+            if (m_mode != Stream::WRITE || !m_count)
+                return;
+
+            size_t count = m_count;
+            m_count = 0;
+            write_all(m_buffer, count);
+        }
+
+        void write(const u8* data, size_t size)
+        {
+            if (m_count + size <= m_capacity)
+            {
+                std::memcpy(m_buffer + m_count, data, size);
+                m_count += size;
+                if (m_count == m_capacity)
+                {
+                    flush();
+                }
+                return;
+            }
+
+            if (size < m_capacity / 2)
+            {
+                size_t bytes = m_capacity - m_count;
+                std::memcpy(m_buffer + m_count, data, bytes);
+                m_count = m_capacity;
+                flush();
+
+                std::memcpy(m_buffer, data + bytes, size - bytes);
+                m_count = size - bytes;
+                return;
+            }
+
+            // large write: bypass the buffer
+            flush();
+            write_all(data, size);
+        }
+
+        void read(u8* dest, size_t size)
+        {
+            size_t available = m_count - m_cursor;
+            if (size <= available)
+            {
+                std::memcpy(dest, m_buffer + m_cursor, size);
+                m_cursor += size;
+                return;
+            }
+
+            std::memcpy(dest, m_buffer + m_cursor, available);
+            dest += available;
+            size -= available;
+
+            m_position += m_count;
+            m_count = 0;
+            m_cursor = 0;
+
+            if (size >= m_capacity)
+            {
+                // large read: bypass the buffer
+                DWORD bytes_read = 0;
+                ReadFile(m_handle, dest, static_cast<DWORD>(size), &bytes_read, NULL);
+                m_position += bytes_read;
+                return;
+            }
+
+            DWORD bytes_read = 0;
+            ReadFile(m_handle, m_buffer, static_cast<DWORD>(m_capacity), &bytes_read, NULL);
+            m_count = bytes_read;
+            m_cursor = std::min(size, m_count);
+            std::memcpy(dest, m_buffer, m_cursor);
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // NativeFileStream
+    // -----------------------------------------------------------------
+
+    NativeFileStream::NativeFileStream(const std::string& filename, OpenMode mode, u32 flags, size_t buffer_size)
+        : m_handle(nullptr)
+    {
+        if (mode != READ && mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Incorrect OpenMode.");
+        }
+
+        m_handle = new NativeFileHandle(filename, mode, flags, buffer_size);
+    }
+
+    NativeFileStream::~NativeFileStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& NativeFileStream::filename() const
+    {
+        return m_handle->m_filename;
+    }
+
+    u64 NativeFileStream::size() const
+    {
+        return m_handle->size();
+    }
+
+    u64 NativeFileStream::offset() const
+    {
+        return m_handle->offset();
+    }
+
+    void NativeFileStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+
+            case CURRENT:
+                target = m_handle->offset() + distance;
+                break;
+
+            case END:
+                target = m_handle->size() + distance;
+                break;
+
+            default:
+                MANGO_EXCEPTION("[NativeFileStream] Invalid seek mode.");
+        }
+
+        m_handle->seek(target);
+    }
+
+    void NativeFileStream::read(void* dest, size_t size)
+    {
+        if (m_handle->m_mode != READ)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not readable.");
+        }
+
+        m_handle->read(reinterpret_cast<u8*>(dest), size);
+    }
+
+    void NativeFileStream::write(const void* data, size_t size)
+    {
+        if (m_handle->m_mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not writable.");
+        }
+
+        m_handle->write(reinterpret_cast<const u8*>(data), size);
+    }
+
+    void NativeFileStream::write(const ConstMemory* spans, size_t count)
+    {
+        if (m_handle->m_mode != WRITE)
+        {
+            MANGO_EXCEPTION("[NativeFileStream] Stream is not writable.");
+        }
+
+        // WriteFileGather() requires unbuffered, page aligned I/O; the spans are
+        // combined in the write buffer instead
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_handle->write(spans[i].address, spans[i].size);
+        }
+    }
+
+    void NativeFileStream::flush()
+    {
+        m_handle->flush();
+    }
+
+    // -----------------------------------------------------------------
+    // MappedFileHandle
+    // -----------------------------------------------------------------
+
+    struct MappedFileHandle
+    {
+        std::string m_filename;
+        HANDLE m_file;
+        HANDLE m_mapping;
+        u8* m_address;
+        size_t m_capacity;
+        size_t m_size;
+        size_t m_offset;
+
+        MappedFileHandle(const std::string& filename, u64 reserve)
+            : m_filename(filename)
+            , m_file(INVALID_HANDLE_VALUE)
+            , m_mapping(NULL)
+            , m_address(nullptr)
+            , m_capacity(0)
+            , m_size(0)
+            , m_offset(0)
+        {
+            m_file = CreateFileW(u16_fromBytes(filename).c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (m_file == INVALID_HANDLE_VALUE)
+            {
+                MANGO_EXCEPTION("[MappedFileStream] File \"%s\" cannot be opened.", filename.c_str());
+            }
+
+            if (reserve)
+            {
+                grow(size_t(reserve));
+            }
+        }
+
+        ~MappedFileHandle()
+        {
+            unmap();
+
+            // discard the unused reserved space
+            resize(m_size);
+
+            CloseHandle(m_file);
+        }
+
+        void unmap()
+        {
+            if (m_address)
+            {
+                UnmapViewOfFile(m_address);
+                m_address = nullptr;
+            }
+
+            if (m_mapping)
+            {
+                CloseHandle(m_mapping);
+                m_mapping = NULL;
+            }
+        }
+
+        bool resize(size_t size)
+        {
+            LARGE_INTEGER dist;
+            dist.QuadPart = size;
+            return SetFilePointerEx(m_file, dist, NULL, FILE_BEGIN) && SetEndOfFile(m_file);
+        }
+
+        void grow(size_t required)
+        {
+            if (required <= m_capacity)
+                return;
+
+            // the view has to be re-created to grow the file
+            const size_t granularity = 64 * 1024;
+            size_t capacity = std::max(std::max(required, m_capacity * 2), size_t(1024 * 1024));
+            capacity = (capacity + granularity - 1) & ~(granularity - 1);
+
+            unmap();
+            m_capacity = 0;
+
+            if (!resize(capacity))
+            {
+                MANGO_EXCEPTION("[MappedFileStream] Resizing \"%s\" failed.", m_filename.c_str());
+            }
+
+            const u64 size = capacity;
+            m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, DWORD(size >> 32), DWORD(size), NULL);
+            if (m_mapping)
+            {
+                m_address = reinterpret_cast<u8*>(MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, capacity));
+            }
+
+            if (!m_address)
+            {
+                MANGO_EXCEPTION("[MappedFileStream] Mapping \"%s\" failed.", m_filename.c_str());
+            }
+
+            m_capacity = capacity;
+        }
+    };
+
+    // -----------------------------------------------------------------
+    // MappedFileStream
+    // -----------------------------------------------------------------
+
+    MappedFileStream::MappedFileStream(const std::string& filename, u64 reserve)
+        : m_handle(nullptr)
+    {
+        m_handle = new MappedFileHandle(filename, reserve);
+    }
+
+    MappedFileStream::~MappedFileStream()
+    {
+        delete m_handle;
+    }
+
+    const std::string& MappedFileStream::filename() const
+    {
+        return m_handle->m_filename;
+    }
+
+    u64 MappedFileStream::size() const
+    {
+        return m_handle->m_size;
+    }
+
+    u64 MappedFileStream::offset() const
+    {
+        return m_handle->m_offset;
+    }
+
+    void MappedFileStream::seek(u64 distance, SeekMode mode)
+    {
+        u64 target;
+
+        switch (mode)
+        {
+            case BEGIN:
+                target = distance;
+                break;
+
+            case CURRENT:
+                target = m_handle->m_offset + distance;
+                break;
+
+            case END:
+                target = m_handle->m_size + distance;
+                break;
+
+            default:
+                MANGO_EXCEPTION("[MappedFileStream] Invalid seek mode.");
+        }
+
+        // seeking past the end extends the file with zeros
+        m_handle->grow(size_t(target));
+        m_handle->m_offset = size_t(target);
+        m_handle->m_size = std::max(m_handle->m_size, m_handle->m_offset);
+    }
+
+    void MappedFileStream::read(void* dest, size_t size)
+    {
+        size_t offset = m_handle->m_offset;
+        if (offset + size > m_handle->m_size)
+        {
+            MANGO_EXCEPTION("[MappedFileStream] Reading past end of file.");
+        }
+
+        std::memcpy(dest, m_handle->m_address + offset, size);
+        m_handle->m_offset = offset + size;
+    }
+
+    void MappedFileStream::write(const void* data, size_t size)
+    {
+        Memory dest = acquire(size);
+        std::memcpy(dest.address, data, size);
+        commit(size);
+    }
+
+    Memory MappedFileStream::acquire(size_t bytes)
+    {
+        m_handle->grow(m_handle->m_offset + bytes);
+        return Memory(m_handle->m_address + m_handle->m_offset, bytes);
+    }
+
+    void MappedFileStream::commit(size_t bytes)
+    {
+        size_t offset = m_handle->m_offset + bytes;
+        if (offset > m_handle->m_capacity)
+        {
+            MANGO_EXCEPTION("[MappedFileStream] Commit exceeds the acquired memory.");
+        }
+
+        m_handle->m_offset = offset;
+        m_handle->m_size = std::max(m_handle->m_size, offset);
+    }
+
+    Memory MappedFileStream::memory() const
+    {
+        return Memory(m_handle->m_address, m_handle->m_size);
+    }
+
 } // namespace filesystem
 } // namespace mango
@@ -905,38 +905,34 @@ namespace
         const bool origin = (block.getCompressionFlags() & TextureCompressionInfo::ORIGIN) != 0;
         const u8* data = memory.address;
 
-        ConcurrentQueue queue;
-
-        for (int y = 0; y < ysize; ++y)
+        parallel_for(0, ysize, [&] (size_t y0, size_t y1)
         {
-            u8* image = surface.image;
-            int stride = surface.stride;
-
-            if (origin)
-            {
-                image += (ysize - y) * blockImageStride;
-                image -= stride;
-                stride = -stride;
-            }
-            else
+            for (int y = int(y0); y < int(y1); ++y)
             {
-                image += y * blockImageStride;
-            }
+                u8* image = surface.image;
+                int stride = surface.stride;
 
-            queue.enqueue([&] (u8* image, const u8* data)
-            {
-                for (int x = 0; x < xsize; ++x)
+                if (origin)
                 {
-                    block.decode(block, image, data, stride);
-                    image += blockImageSize;
-                    data += block.bytes;
+                    image += (ysize - y) * blockImageStride;
+                    image -= stride;
+                    stride = -stride;
+                }
+                else
+                {
+                    image += y * blockImageStride;
                 }
-            }, image, data);
 
-            data += block.bytes * xsize;
-        }
+                const u8* src = data + y * block.bytes * xsize;
 
-        queue.wait();
+                for (int x = 0; x < xsize; ++x)
+                {
+                    block.decode(block, image, src, stride);
+                    image += blockImageSize;
+                    src += block.bytes;
+                }
+            }
+        });
     }
 
     void clipConvertBlockDecode(const TextureCompressionInfo& block, const Surface& surface, ConstMemory memory, int xsize, int ysize)
@@ -952,35 +948,35 @@ namespace
 
         const int blockStride = block.width * surface.format.bytes();
         const int xblocks = ceil_div(surface.width, block.width);
+        const int yblocks = ceil_div(surface.height, block.height);
 
-        ConcurrentQueue queue;
-
-        for (int y = 0; y < surface.height; y += block.height)
+        parallel_for(0, yblocks, [&] (size_t y0, size_t y1)
         {
-            rect.dest.address = surface.image + (origin ? surface.height - y - 1 : y) * surface.stride;
-            rect.height = std::min(y + block.height, surface.height) - y; // vertical clipping
+            Buffer temp(block.height * rect.src.stride);
 
-            queue.enqueue([&] (BlitRect rect, const u8* data)
+            for (int yblock = int(y0); yblock < int(y1); ++yblock)
             {
-                Buffer temp(block.height * rect.src.stride);
-                rect.src.address = temp;
+                const int y = yblock * block.height;
+
+                BlitRect temprect = rect;
+                temprect.src.address = temp;
+                temprect.dest.address = surface.image + (origin ? surface.height - y - 1 : y) * surface.stride;
+                temprect.height = std::min(y + block.height, surface.height) - y; // vertical clipping
+
+                const u8* src = data + yblock * block.bytes * xblocks;
 
                 for (int x = 0; x < surface.width; x += block.width)
                 {
-                    block.decode(block, temp, data, rect.src.stride);
+                    block.decode(block, temp, src, temprect.src.stride);
 
-                    rect.width = std::min(x + block.width, surface.width) - x; // horizontal clipping
-                    blitter.convert(rect);
+                    temprect.width = std::min(x + block.width, surface.width) - x; // horizontal clipping
+                    blitter.convert(temprect);
 
-                    rect.dest.address += blockStride;
-                    data += block.bytes;
+                    temprect.dest.address += blockStride;
+                    src += block.bytes;
                 }
-            }, rect, data);
-
-            data += block.bytes * xblocks;
-        }
-
-        queue.wait();
+            }
+        });
     }
 
     // surface decode
@@ -1163,18 +1159,21 @@ namespace mango
             return status;
         }
 
-        ConcurrentQueue queue;
-
         u8* address = memory.address;
 
         const int xblocks = ceil_div(surface.width, width);
         const int yblocks = ceil_div(surface.height, height);
 
-        for (int y = 0; y < yblocks; ++y)
+        parallel_for(0, yblocks, [&] (size_t y0, size_t y1)
         {
-            queue.enqueue([this, y, xblocks, &surface, address]
+            Arena& arena = getThreadArena();
+            ArenaScope scope(arena);
+
+            const int stride = width * format.bytes();
+            Surface temp(width, height, format, stride, arena.allocate<u8>(stride * height));
+
+            for (int y = int(y0); y < int(y1); ++y)
             {
-                Bitmap temp(width, height, format);
                 u8* data = address + y * xblocks * bytes;
 
                 for (int x = 0; x < xblocks; ++x)
@@ -1186,10 +1185,8 @@ namespace mango
                     encode(*this, data, image, temp.stride);
                     data += bytes;
                 }
-            });
-        }
-
-        queue.wait();
+            }
+        });
 
         return status;
     }
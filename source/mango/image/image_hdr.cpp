@@ -249,7 +249,9 @@ namespace
 
     void hdr_decode(ImageDecodeStatus& status, Surface& surface, const u8* data)
     {
-        Buffer buffer(surface.width * 4);
+        Arena& arena = getThreadArena();
+        ArenaScope scope(arena);
+        Buffer buffer(surface.width * 4, arena);
 
 		for (int y = 0; y < surface.height; ++y)
 		{
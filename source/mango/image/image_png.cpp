@@ -2196,7 +2196,8 @@ namespace
 
         try
         {
-            size_t bytes_out = zlib::decompress(buffer, m_compressed);
+            DecompressContext& context = getThreadDecompressContext(Compressor::ZLIB);
+            size_t bytes_out = context.decompress(buffer, m_compressed);
             debugPrint("  # total_out:  %d\n", int(bytes_out));
             MANGO_UNREFERENCED(bytes_out);
         }
@@ -2371,6 +2372,9 @@ namespace
         int bpp = surface.format.bytes();
         int bytes_per_scan = surface.width * bpp;
 
+        // the filtered size is known; reserve it so that appending never grows the buffer
+        buffer.reserve(size_t(bytes_per_scan + PNG_FILTER_BYTE) * surface.height);
+
         Buffer zero(bytes_per_scan, 0);
         u8* prev = zero;
 
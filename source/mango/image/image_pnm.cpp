@@ -418,10 +418,7 @@ namespace
                     {
                         float* image = dest.address<float>(0, m_header.height - 1 - y);
 
-                        for (int x = 0; x < xcount; ++x)
-                        {
-                            image[x] = ptr.read32f();
-                        }
+                        ptr.read_f32_array(image, xcount);
                     }
                 }
                 else
@@ -432,10 +429,7 @@ namespace
                     {
                         float* image = dest.address<float>(0, m_header.height - 1 - y);
 
-                        for (int x = 0; x < xcount; ++x)
-                        {
-                            image[x] = ptr.read32f();
-                        }
+                        ptr.read_f32_array(image, xcount);
                     }
                 }
             }
@@ -483,14 +477,16 @@ namespace
                 else
                 {
                     BigEndianConstPointer e = p;
+                    std::vector<u16> samples(xcount);
 
                     for (int y = 0; y < m_header.height; ++y)
                     {
                         u8* image = dest.address<u8>(0, y);
+                        e.read16_array(samples.data(), xcount);
 
                         for (int x = 0; x < xcount; ++x)
                         {
-                            int value = e.read16();
+                            int value = samples[x];
                             image[x] = u8(value * 255 / m_header.maxvalue);
                         }
                     }
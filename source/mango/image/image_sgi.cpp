@@ -156,15 +156,8 @@ namespace
             std::vector<u32> offsets(num);
             std::vector<s32> sizes(num);
 
-            for (int i = 0; i < num; ++i)
-            {
-                offsets[i] = p.read32();
-            }
-
-            for (int i = 0; i < num; ++i)
-            {
-                sizes[i] = p.read32();
-            }
+            p.read32_array(offsets.data(), num);
+            p.read32_array(reinterpret_cast<u32*>(sizes.data()), num);
 
             for (int channel = 0; channel < channels; ++channel)
             {
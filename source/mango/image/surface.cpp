@@ -187,7 +187,7 @@ namespace
             surface.height = header.height;
             surface.format = format ? *format : header.format;
             surface.stride = surface.width * surface.format.bytes();
-            surface.image  = new u8[surface.height * surface.stride];
+            surface.image  = aligned_alloc<u8>(surface.height * surface.stride, Alignment());
 
             // decode
             ImageDecodeStatus status = decoder.decode(surface);
@@ -216,7 +216,7 @@ namespace
                 surface.height = header.height;
                 surface.format = IndexedFormat(8);
                 surface.stride = surface.width;
-                surface.image  = new u8[surface.height * surface.stride];
+                surface.image  = aligned_alloc<u8>(surface.height * surface.stride, Alignment());
 
                 // decode
                 ImageDecodeOptions options;
@@ -414,58 +414,31 @@ namespace mango
         rect.width = dest.width;
         rect.height = dest.height;
 
-        ConcurrentQueue queue("blit", Priority::HIGH);
-
         Blitter blitter(dest.format, source.format);
 
-        const int threads = ThreadPool::getInstanceSize();
-        const int tasksize = (rect.width * rect.height) / threads;
-
-        const bool fast = dest.format == source.format;
-
-        // don't use thread pool for:
-        // - really small tasks
-        // - when the pixel formats are identical ("fast mode")
-        const int N = (tasksize < 8192) || fast ? 1 : threads;
-        const int section = rect.height / N;
-
-        int ypos = 0;
-
-        // queue conversion tasks
-        for (int i = 0; i < N; ++i)
+        auto convert = [&] (size_t y0, size_t y1)
         {
-            const bool last = (i == (N - 1));
-            const int ycount = last ? rect.height - ypos : section;
-
-            if (N == 1)
-            {
-                // execute on main thread
-                BlitRect temp = rect;
-
-                temp.dest.address += ypos * rect.dest.stride;
-                temp.src.address += ypos * rect.src.stride;
-                temp.height = ycount;
+            BlitRect temp = rect;
 
-                blitter.convert(temp);
-            }
-            else
-            {
-                queue.enqueue([=, &blitter]
-                {
-                    BlitRect temp = rect;
+            // the stride can be negative; compute the offset in signed arithmetic
+            temp.dest.address += ptrdiff_t(y0) * ptrdiff_t(rect.dest.stride);
+            temp.src.address += ptrdiff_t(y0) * ptrdiff_t(rect.src.stride);
+            temp.height = int(y1 - y0);
 
-                    temp.dest.address += ypos * rect.dest.stride;
-                    temp.src.address += ypos * rect.src.stride;
-                    temp.height = ycount;
+            blitter.convert(temp);
+        };
 
-                    blitter.convert(temp);
-                });
-            }
-
-            ypos += section;
+        if (dest.format == source.format)
+        {
+            // identical pixel formats ("fast mode") are memory bound; no threading
+            convert(0, rect.height);
+        }
+        else
+        {
+            // the grain is computed from the measured conversion cost; small
+            // surfaces are converted on the calling thread
+            parallel_for(0, rect.height, convert);
         }
-
-        queue.wait();
     }
 
     void Surface::xflip() const
@@ -534,6 +507,11 @@ namespace mango
     // ----------------------------------------------------------------------------
 
     Bitmap::Bitmap(int w, int h, const Format& f, int s)
+        : Bitmap(w, h, f, s, Alignment())
+    {
+    }
+
+    Bitmap::Bitmap(int w, int h, const Format& f, int s, Alignment alignment)
         : Surface(w, h, f, s, nullptr)
     {
         if (!stride)
@@ -541,14 +519,14 @@ namespace mango
             stride = width * format.bytes();
         }
 
-        image = new u8[stride * height];
+        image = aligned_alloc<u8>(size_t(stride) * height, alignment);
     }
 
     Bitmap::Bitmap(const Surface& source, const Format& format)
         : Surface(source.width, source.height, format, 0, nullptr)
     {
         stride = width * format.bytes();
-        image = new u8[stride * height];
+        image = aligned_alloc<u8>(size_t(stride) * height, Alignment());
         blit(0, 0, source);
     }
 
@@ -591,11 +569,17 @@ namespace mango
 
     Bitmap::~Bitmap()
     {
-        delete[] image;
+        aligned_free(image);
     }
 
     Bitmap& Bitmap::operator = (Bitmap&& bitmap)
     {
+        if (this == &bitmap)
+            return *this;
+
+        // release current image
+        aligned_free(image);
+
         // copy surface
         format = bitmap.format;
         image = bitmap.image;
@@ -57,6 +57,8 @@ namespace jpeg {
     using mango::Surface;
 	using mango::Stream;
     using mango::ThreadPool;
+    using mango::parallel_for;
+    using mango::parallel_grain;
     using mango::Memory;
     using mango::ConstMemory;
 
@@ -369,7 +371,7 @@ namespace jpeg {
         void decodeProgressive();
         void finishProgressive();
         void finishProgressiveST();
-        void finishProgressiveMT(int N);
+        void finishProgressiveMT();
 
         void process_range(int y0, int y1, const s16* data);
         void process_and_clip(u8* dest, int stride, const s16* data, int width, int height);
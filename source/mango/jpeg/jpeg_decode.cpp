@@ -1873,26 +1873,12 @@ namespace jpeg {
 
     int Parser::getTaskSize(int count) const
     {
-        int threads = m_hardware_concurrency;
-        if (threads == 1)
+        if (m_hardware_concurrency == 1)
         {
-            //printf("Scheduling: %d in %d threads.\n", count, threads);
             return count;
         }
 
-        // adjust the number of threads:
-        // - large thread count is fine as-is; we don't want too much overhead
-        // - small thread count needs finer-grained granularity so that cpu cores have enough work
-        if (threads < 16)
-        {
-            threads *= 2;
-        }
-
-        const int N = (count / threads) + 1;
-
-        //printf("Scheduling: %d scans in %d threads.\n", count, threads);
-        //printf("  size: %d, tasks: %d\n", N, (count + N - 1) / N);
-        return N;
+        return int(parallel_grain(count));
     }
 
     void Parser::decodeLossless()
@@ -2234,11 +2220,10 @@ namespace jpeg {
 
     void Parser::finishProgressive()
     {
-        int n = getTaskSize(ymcu);
-        if (n == ymcu)
+        if (m_hardware_concurrency == 1)
             finishProgressiveST();
         else
-            finishProgressiveMT(n);
+            finishProgressiveMT();
     }
 
     void Parser::finishProgressiveST()
@@ -2290,25 +2275,18 @@ namespace jpeg {
         process_and_clip(image, stride, data, xblock_last, yblock_last);
     }
 
-    void Parser::finishProgressiveMT(int N)
+    void Parser::finishProgressiveMT()
     {
-        // use threadpool to process blocks
-        ConcurrentQueue queue("jpeg.progressive", Priority::HIGH);
+        const int mcu_data_size = blocks_in_mcu * 64;
 
-        for (int y = 0; y < ymcu; y += N)
+        // the block data is already decoded; the rows are independent
+        parallel_for(0, ymcu, [this, mcu_data_size] (size_t y0, size_t y1)
         {
-            const int y0 = y;
-            const int y1 = std::min(y + N, ymcu);
-            debugPrint("  Process: [%d, %d] --> ThreadPool.\n", y0, y1 - 1);
-
-            s16* data = blockVector + y0 * xmcu * (blocks_in_mcu * 64);
+            debugPrint("  Process: [%d, %d] --> ThreadPool.\n", int(y0), int(y1 - 1));
 
-            // enqueue task
-            queue.enqueue([=]
-            {
-                process_range(y0, y1, data);
-            });
-        }
+            s16* data = blockVector + y0 * xmcu * mcu_data_size;
+            process_range(int(y0), int(y1), data);
+        });
     }
 
     void Parser::process_range(int y0, int y1, const s16* data)